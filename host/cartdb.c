@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cartdb.h"
+
+static bool cartdb_size(const char *text, uint32_t *size) {
+	char *end;
+	unsigned long value = strtoul(text, &end, 10);
+	if (end == text) return false;
+	if (*end == 'K' || *end == 'k') {
+		value <<= 10;
+		end++;
+	} else if (*end == 'M' || *end == 'm') {
+		value <<= 20;
+		end++;
+	}
+	*size = value;
+	return *end == 0;
+}
+
+static int cartdb_compare(const void *a, const void *b) {
+	return strcmp(((const cartdb_entry_t*) a)->key, ((const cartdb_entry_t*) b)->key);
+}
+
+bool cartdb_load(cartdb_t *db, const char *path, unsigned int *error_line) {
+	char line[512], key[64], rom[16], sram[16], eeprom[16];
+	size_t capacity = 0;
+	FILE *f = fopen(path, "r");
+
+	db->entries = NULL;
+	db->count = 0;
+	*error_line = 0;
+	if (f == NULL) return false;
+
+	while (fgets(line, sizeof(line), f)) {
+		(*error_line)++;
+		char *p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == 0) continue;
+
+		cartdb_entry_t entry;
+		if (sscanf(p, "%63s %15s %15s %15s", key, rom, sram, eeprom) != 4
+			|| strlen(key) != STORE_KEY_LEN - 1
+			|| !cartdb_size(rom, &entry.rom) || !cartdb_size(sram, &entry.sram)
+			|| !cartdb_size(eeprom, &entry.eeprom)
+			|| entry.rom == 0 || entry.rom > (1024 << 16) || (entry.rom & 0xFFFF)
+			|| (entry.sram & 0x3FF) || entry.eeprom > 2048) {
+			fclose(f);
+			cartdb_free(db);
+			return false;
+		}
+		strcpy(entry.key, key);
+		if (db->count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			db->entries = realloc(db->entries, capacity * sizeof(cartdb_entry_t));
+		}
+		db->entries[db->count++] = entry;
+	}
+	fclose(f);
+	qsort(db->entries, db->count, sizeof(cartdb_entry_t), cartdb_compare);
+	*error_line = 0;
+	return true;
+}
+
+void cartdb_free(cartdb_t *db) {
+	free(db->entries);
+	db->entries = NULL;
+	db->count = 0;
+}
+
+const cartdb_entry_t *cartdb_find(const cartdb_t *db, const uint8_t header[16]) {
+	cartdb_entry_t entry;
+	store_key(header, entry.key);
+	return bsearch(&entry, db->entries, db->count, sizeof(cartdb_entry_t), cartdb_compare);
+}
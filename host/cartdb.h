@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "store.h"
+
+/**
+ * Known-cartridge database: exact memory sizes by header, for carts whose
+ * header size bytes are missing or wrong. A text file, one cartridge per
+ * line, keyed as in the dump store (store_key()):
+ *
+ *   # key            ROM    SRAM  EEPROM  title
+ *   01-0003-00-1a2b  4M     32K   0       any text
+ *
+ * Sizes are in bytes, with an optional K or M suffix.
+ */
+
+typedef struct {
+	char key[STORE_KEY_LEN];
+	uint32_t rom;
+	uint32_t sram;
+	uint32_t eeprom;
+} cartdb_entry_t;
+
+typedef struct {
+	cartdb_entry_t *entries;
+	size_t count;
+} cartdb_t;
+
+// on a malformed line, returns false with its number in *error_line
+bool cartdb_load(cartdb_t *db, const char *path, unsigned int *error_line);
+void cartdb_free(cartdb_t *db);
+
+const cartdb_entry_t *cartdb_find(const cartdb_t *db, const uint8_t header[16]);
@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Programs and erases a modeled flash chip with the reference version of
+ * each FLASH_MODE_* driver, and reports bus traffic and modeled time.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash.h"
+#include "flash_model.h"
+#include "flash_ref.h"
+
+typedef struct {
+	const char *name;
+	uint16_t mode;
+	const flash_chip_t *chip;
+} bench_mode_t;
+
+static const bench_mode_t bench_modes[] = {
+	{"slow", FLASH_MODE_SLOW, &flash_chip_generic},
+	{"slow", FLASH_MODE_SLOW, &flash_chip_mbm29dl400},
+	{"wonderwitch", FLASH_MODE_FAST_WONDERWITCH, &flash_chip_mbm29dl400},
+	{"flashmasta", FLASH_MODE_FAST_FLASHMASTA, &flash_chip_wsfm},
+	{"mx29l", FLASH_MODE_FAST_MX29L, &flash_chip_mx29l3211},
+};
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -k kbytes      amount to program per mode (default: 16)\n"
+		"  -w cycles      cycles per cartridge bus access (default: 1)\n"
+		"  -e             also time erasing 64 KB in 1 KB and in 8 KB steps\n"
+		"  -f             also inject a failed program and erase per mode, and check\n"
+		"                 that each is caught and redone as xmf_write() does\n", name);
+}
+
+static bool bench_blank(flash_model_t *m, uint32_t offset, uint32_t len) {
+	bool blank = true;
+	for (uint32_t i = 0; i < len; i++) {
+		if (flash_model_read(m, offset + i) != 0xFF) blank = false;
+	}
+	return blank;
+}
+
+// program and read back, as xmf_program() does
+static bool bench_program(flash_model_t *m, const uint8_t *data, uint32_t offset, uint16_t len, uint16_t mode) {
+	bool result = flash_ref_write(m, data, offset, len, mode);
+	for (uint16_t i = 0; i < len && result; i++) {
+		if (flash_model_read(m, offset + i) != data[i]) result = false;
+	}
+	return result;
+}
+
+// one bad program in the second chunk, one bad erase of the first sector
+static void bench_faults(const bench_mode_t *b, const uint8_t *image, uint8_t access_cycles) {
+	flash_model_t m;
+	bool detected = true, redone = true;
+
+	flash_model_init(&m, b->chip, access_cycles);
+	m.fault_addr = 128 + 5;
+	m.fault_count = 1;
+	for (uint32_t offset = 0; offset < 512; offset += 128) {
+		if (bench_program(&m, image + offset, offset, 128, b->mode)) {
+			if (offset == 128) detected = false;
+		} else if (!bench_program(&m, image + offset, offset, 128, b->mode)) {
+			redone = false;
+		}
+	}
+	redone &= !memcmp(m.data, image, 512);
+
+	m.fault_addr = 0;
+	m.fault_count = 1;
+	if (flash_ref_erase(&m, 0, b->mode) && bench_blank(&m, 0, 512)) detected = false;
+	if (!flash_ref_erase(&m, 0, b->mode) || !bench_blank(&m, 0, 512)) redone = false;
+
+	printf("%-12s %-16s %8u %8s %8s %6u\n", b->name, b->chip->name, m.counters.faults,
+		detected ? "yes" : "NO", redone ? "yes" : "NO", m.counters.errors);
+	flash_model_free(&m);
+}
+
+int main(int argc, char **argv) {
+	uint32_t kbytes = 16;
+	uint8_t access_cycles = 1;
+	bool erase = false, faults = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "k:w:efh")) != -1) {
+		switch (opt) {
+		case 'k': kbytes = strtoul(optarg, NULL, 0); break;
+		case 'w': access_cycles = strtoul(optarg, NULL, 0); break;
+		case 'e': erase = true; break;
+		case 'f': faults = true; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (kbytes == 0 || kbytes > 64 || access_cycles == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint32_t size = kbytes * 1024;
+	uint8_t *image = malloc(size);
+	srand(1);
+	for (uint32_t i = 0; i < size; i++) {
+		image[i] = rand();
+	}
+
+	printf("%u KB, %u cycle(s) per bus access, %.3f MHz CPU\n\n", kbytes, access_cycles, FLASH_MODEL_CPU_HZ / 1e6);
+	printf("%-12s %-16s %9s %8s %8s %10s %10s %8s %6s %s\n",
+		"mode", "chip", "writes/KB", "reads/KB", "polls/KB", "cycles/KB", "us/KB", "KB/s", "errors", "result");
+
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(bench_modes) / sizeof(*bench_modes); i++) {
+		const bench_mode_t *b = &bench_modes[i];
+		flash_model_t m;
+		bool ok = true;
+
+		flash_model_init(&m, b->chip, access_cycles);
+		// 128 bytes at a time, as xmf_write() does
+		for (uint32_t offset = 0; offset < size; offset += 128) {
+			ok &= flash_ref_write(&m, image + offset, offset, 128, b->mode);
+		}
+		ok &= !memcmp(m.data, image, size);
+		if (!ok) failed++;
+
+		flash_model_counters_t *c = &m.counters;
+		printf("%-12s %-16s %9.0f %8.0f %8.0f %10.0f %10.1f %8.1f %6u %s\n",
+			b->name, b->chip->name,
+			(double) c->writes / kbytes, (double) c->reads / kbytes, (double) c->busy_reads / kbytes,
+			(double) c->cycles / kbytes, flash_model_us(&m) / kbytes,
+			kbytes * 1000000.0 / flash_model_us(&m), c->errors, ok ? "OK" : "FAILED");
+		flash_model_free(&m);
+	}
+
+	if (erase) {
+		printf("\n%-16s %22s %22s\n", "chip", "64 KB, 1 KB steps (ms)", "64 KB, 8 KB steps (ms)");
+		for (size_t i = 0; i < sizeof(bench_modes) / sizeof(*bench_modes); i++) {
+			const bench_mode_t *b = &bench_modes[i];
+			if (i > 0 && b->chip == bench_modes[i - 1].chip) continue;
+			flash_model_t m;
+			double kb_steps, sector_steps;
+
+			// every kilobyte, as xmf_erase() used to
+			flash_model_init(&m, b->chip, access_cycles);
+			memset(m.data, 0x00, b->chip->size);
+			for (uint32_t offset = 0; offset < 0x10000; offset += 1024) {
+				flash_ref_erase(&m, offset, b->mode);
+			}
+			kb_steps = flash_model_us(&m) / 1000;
+			flash_model_free(&m);
+
+			// every 8 KB region not already blank, as xmf_erase() does
+			flash_model_init(&m, b->chip, access_cycles);
+			memset(m.data, 0x00, b->chip->size);
+			for (uint32_t offset = 0; offset < 0x10000; offset += 0x2000) {
+				if (!bench_blank(&m, offset, 0x2000)) flash_ref_erase(&m, offset, b->mode);
+			}
+			sector_steps = flash_model_us(&m) / 1000;
+			flash_model_free(&m);
+
+			printf("%-16s %22.0f %22.0f\n", b->chip->name, kb_steps, sector_steps);
+		}
+	}
+
+	if (faults) {
+		printf("\n%-12s %-16s %8s %8s %8s %6s\n", "mode", "chip", "faults", "caught", "redone", "errors");
+		for (size_t i = 0; i < sizeof(bench_modes) / sizeof(*bench_modes); i++) {
+			bench_faults(&bench_modes[i], image, access_cycles);
+		}
+	}
+
+	free(image);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "flash_model.h"
+
+const flash_chip_t flash_chip_generic = {
+	.name = "AMD command set", .size = 0x80000, .sector_size = 0x10000,
+	.program_ns = 9000, .sector_erase_ns = 700000000
+};
+
+const flash_chip_t flash_chip_mbm29dl400 = {
+	.name = "MBM29DL400BC", .size = 0x80000, .sector_size = 0x10000,
+	.unlock_bypass = true,
+	.program_ns = 8000, .sector_erase_ns = 1000000000
+};
+
+const flash_chip_t flash_chip_wsfm = {
+	.name = "WSFM", .size = 0x800000, .sector_size = 0x10000,
+	.unlock_bypass = true,
+	.program_ns = 9000, .sector_erase_ns = 600000000
+};
+
+const flash_chip_t flash_chip_mx29l3211 = {
+	.name = "MX29L3211", .size = 0x400000, .sector_size = 0x10000,
+	.page_size = 256, .page_load_ns = 100000, .status_register = true,
+	.page_program_ns = 1200000, .sector_erase_ns = 1200000000
+};
+
+enum {
+	STATE_READ,
+	STATE_UNLOCK1,
+	STATE_UNLOCK2,
+	STATE_PROGRAM,
+	STATE_PAGE_LOAD,
+	STATE_ERASE_SETUP,
+	STATE_ERASE_UNLOCK1,
+	STATE_ERASE_UNLOCK2,
+	STATE_BYPASS_EXIT
+};
+
+#define CMD_ADDR1 0xAAA
+#define CMD_ADDR2 0x555
+
+static uint64_t flash_model_ns_to_cycles(uint32_t ns) {
+	return (uint64_t) ns * FLASH_MODEL_CPU_HZ / 1000000000;
+}
+
+void flash_model_init(flash_model_t *m, const flash_chip_t *chip, uint8_t access_cycles) {
+	memset(m, 0, sizeof(*m));
+	m->chip = chip;
+	m->access_cycles = access_cycles;
+	m->data = malloc(chip->size);
+	memset(m->data, 0xFF, chip->size);
+}
+
+void flash_model_free(flash_model_t *m) {
+	free(m->data);
+	m->data = NULL;
+}
+
+static bool flash_model_busy(flash_model_t *m) {
+	return m->counters.cycles < m->busy_until;
+}
+
+static bool flash_model_fault(flash_model_t *m, uint32_t addr, uint32_t mask) {
+	if (!m->fault_count || ((m->fault_addr ^ addr) % m->chip->size) & mask) return false;
+	m->fault_count--;
+	// a status register chip reports ready; only a verify finds the fault
+	m->failed = !m->chip->status_register;
+	m->counters.faults++;
+	return true;
+}
+
+// false if the program failed
+static bool flash_model_program(flash_model_t *m, uint32_t addr, uint8_t value) {
+	addr %= m->chip->size;
+	if (flash_model_fault(m, addr, ~0)) return false;
+	// programming can only clear bits
+	if (value & ~m->data[addr]) m->counters.errors++;
+	m->data[addr] &= value;
+	return true;
+}
+
+// the page program starts once no byte has been loaded for page_load_ns
+static void flash_model_page_check(flash_model_t *m) {
+	if (m->state != STATE_PAGE_LOAD) return;
+	uint64_t start = m->page_last_write + flash_model_ns_to_cycles(m->chip->page_load_ns);
+	if (m->counters.cycles < start) return;
+
+	for (uint16_t i = 0; i < m->chip->page_size; i++) {
+		if (m->page_loaded[i]) flash_model_program(m, m->page_base + i, m->page[i]);
+	}
+	m->busy_until = start + flash_model_ns_to_cycles(m->chip->page_program_ns);
+	m->busy_erase = false;
+	m->status_mode = true;
+	m->counters.page_programs++;
+	m->state = STATE_READ;
+}
+
+void flash_model_cpu(flash_model_t *m, uint32_t cycles) {
+	m->counters.cycles += cycles;
+}
+
+uint8_t flash_model_read(flash_model_t *m, uint32_t addr) {
+	m->counters.cycles += m->access_cycles;
+	m->counters.reads++;
+	flash_model_page_check(m);
+
+	if (m->failed) {
+		m->counters.busy_reads++;
+		m->toggle ^= 0x44;
+		return 0x20 | (~m->busy_value & 0x80) | (m->toggle & 0x40);
+	}
+	if (flash_model_busy(m)) {
+		m->counters.busy_reads++;
+		m->toggle ^= 0x44;
+		if (m->chip->status_register) {
+			// SR7 clear while busy
+			return 0x00 | (m->toggle & 0x40);
+		}
+		// DQ7 inverted while programming, DQ6 toggles, DQ2 toggles in the erasing sector
+		uint8_t dq7 = m->busy_erase ? 0x00 : (~m->busy_value & 0x80);
+		return dq7 | (m->toggle & (m->busy_erase ? 0x44 : 0x40));
+	}
+	if (m->status_mode) {
+		return 0x80;
+	}
+	return m->data[addr % m->chip->size];
+}
+
+static void flash_model_reset(flash_model_t *m) {
+	m->state = STATE_READ;
+	m->status_mode = false;
+	m->failed = false;
+}
+
+void flash_model_write(flash_model_t *m, uint32_t addr, uint8_t value) {
+	uint16_t cmd_addr = addr & 0xFFF;
+
+	m->counters.cycles += m->access_cycles;
+	m->counters.writes++;
+	flash_model_page_check(m);
+
+	if (flash_model_busy(m)) {
+		m->counters.errors++;
+		return;
+	}
+	if (m->failed) {
+		// only a reset leaves the failed state
+		if (value == 0xF0) {
+			flash_model_reset(m);
+		} else {
+			m->counters.errors++;
+		}
+		return;
+	}
+
+	switch (m->state) {
+	case STATE_READ:
+		if (m->bypass && value == 0xA0) {
+			m->state = STATE_PROGRAM;
+		} else if (m->bypass && value == 0x90) {
+			m->state = STATE_BYPASS_EXIT;
+		} else if (value == 0xF0) {
+			flash_model_reset(m);
+		} else if (!m->bypass && cmd_addr == CMD_ADDR1 && value == 0xAA) {
+			m->state = STATE_UNLOCK1;
+		} else {
+			m->counters.errors++;
+		}
+		break;
+	case STATE_UNLOCK1:
+		if (cmd_addr == CMD_ADDR2 && value == 0x55) {
+			m->state = STATE_UNLOCK2;
+		} else {
+			m->counters.errors++;
+			flash_model_reset(m);
+		}
+		break;
+	case STATE_UNLOCK2:
+		m->state = STATE_READ;
+		if (cmd_addr != CMD_ADDR1) {
+			m->counters.errors++;
+		} else if (value == 0xA0) {
+			m->status_mode = false;
+			if (m->chip->page_size) {
+				m->state = STATE_PAGE_LOAD;
+				m->page_base = ~0;
+				memset(m->page_loaded, 0, sizeof(m->page_loaded));
+				m->page_last_write = m->counters.cycles;
+			} else {
+				m->state = STATE_PROGRAM;
+			}
+		} else if (value == 0x80) {
+			m->state = STATE_ERASE_SETUP;
+		} else if (value == 0x20 && m->chip->unlock_bypass) {
+			m->bypass = true;
+		} else if (value == 0xF0) {
+			flash_model_reset(m);
+		} else {
+			m->counters.errors++;
+		}
+		break;
+	case STATE_PROGRAM:
+		m->state = STATE_READ;
+		m->counters.programs++;
+		if (!flash_model_program(m, addr, value)) break;
+		m->busy_until = m->counters.cycles + flash_model_ns_to_cycles(m->chip->program_ns);
+		m->busy_addr = addr;
+		m->busy_value = value;
+		m->busy_erase = false;
+		break;
+	case STATE_PAGE_LOAD: {
+		uint32_t base = addr & ~(uint32_t) (m->chip->page_size - 1);
+		if (m->page_base == (uint32_t) ~0) m->page_base = base;
+		if (base != m->page_base) {
+			// writes must stay within one page
+			m->counters.errors++;
+		} else {
+			m->page[addr - base] = value;
+			m->page_loaded[addr - base] = 1;
+		}
+		m->page_last_write = m->counters.cycles;
+	} break;
+	case STATE_ERASE_SETUP:
+		m->state = (cmd_addr == CMD_ADDR1 && value == 0xAA) ? STATE_ERASE_UNLOCK1 : STATE_READ;
+		if (m->state == STATE_READ) m->counters.errors++;
+		break;
+	case STATE_ERASE_UNLOCK1:
+		m->state = (cmd_addr == CMD_ADDR2 && value == 0x55) ? STATE_ERASE_UNLOCK2 : STATE_READ;
+		if (m->state == STATE_READ) m->counters.errors++;
+		break;
+	case STATE_ERASE_UNLOCK2:
+		m->state = STATE_READ;
+		if (value == 0x30) {
+			uint32_t base = (addr % m->chip->size) & ~(m->chip->sector_size - 1);
+			m->counters.erases++;
+			if (flash_model_fault(m, addr, ~(m->chip->sector_size - 1))) break;
+			memset(m->data + base, 0xFF, m->chip->sector_size);
+			m->busy_until = m->counters.cycles + flash_model_ns_to_cycles(m->chip->sector_erase_ns);
+			m->busy_erase = true;
+		} else {
+			m->counters.errors++;
+		}
+		break;
+	case STATE_BYPASS_EXIT:
+		m->state = STATE_READ;
+		if (value == 0x00 || value == 0xF0) {
+			m->bypass = false;
+		} else {
+			m->counters.errors++;
+		}
+		break;
+	}
+}
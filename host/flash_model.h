@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Model of a cartridge flash chip, as seen through the 0x1000 (SRAM) window:
+ * the AMD command set (unlock cycles at 0xAAA/0x555, program, sector erase,
+ * unlock bypass) plus the page program and status register of the MX29L.
+ *
+ * Time is counted in V30MZ clock cycles. Every bus access costs the
+ * configured number of cycles; the reference drivers add the cycles spent
+ * on instructions that do not touch the bus.
+ */
+
+#define FLASH_MODEL_CPU_HZ 3072000
+
+typedef struct {
+	const char *name;
+	uint32_t size;
+	uint32_t sector_size;
+	// MX29L: A0 loads up to page_size bytes, programmed after page_load_ns without a write
+	uint16_t page_size;
+	uint32_t page_load_ns;
+	bool unlock_bypass;
+	// MX29L: reads return the status register after programming, until reset
+	bool status_register;
+	// typical datasheet figures
+	uint32_t program_ns;
+	uint32_t page_program_ns;
+	uint32_t sector_erase_ns;
+} flash_chip_t;
+
+extern const flash_chip_t flash_chip_generic;
+extern const flash_chip_t flash_chip_mbm29dl400;
+extern const flash_chip_t flash_chip_wsfm;
+extern const flash_chip_t flash_chip_mx29l3211;
+
+typedef struct {
+	uint64_t cycles;
+	uint64_t reads, writes;
+	// reads that returned status while the chip was busy
+	uint64_t busy_reads;
+	uint32_t programs, page_programs, erases;
+	// command sequence errors, writes while busy, and 0 to 1 programming
+	uint32_t errors;
+	// programs and erases failed by fault injection
+	uint32_t faults;
+} flash_model_counters_t;
+
+typedef struct {
+	const flash_chip_t *chip;
+	uint8_t *data;
+	uint8_t access_cycles;
+
+	uint8_t state;
+	bool bypass;
+	bool status_mode;
+	uint8_t toggle;
+	uint64_t busy_until;
+	uint32_t busy_addr;
+	uint8_t busy_value;
+	bool busy_erase;
+
+	// the next fault_count programs of fault_addr, or erases of its sector,
+	// fail: the data is left as it was, and the chip toggles with DQ5 set
+	// until reset with F0 (a status register chip just reports ready)
+	uint32_t fault_addr;
+	uint8_t fault_count;
+	bool failed;
+
+	uint8_t page[256];
+	uint8_t page_loaded[256];
+	uint32_t page_base;
+	uint64_t page_last_write;
+
+	flash_model_counters_t counters;
+} flash_model_t;
+
+// the chip starts erased
+void flash_model_init(flash_model_t *m, const flash_chip_t *chip, uint8_t access_cycles);
+void flash_model_free(flash_model_t *m);
+
+uint8_t flash_model_read(flash_model_t *m, uint32_t addr);
+void flash_model_write(flash_model_t *m, uint32_t addr, uint8_t value);
+// cycles spent on instructions which do not access the cartridge bus
+void flash_model_cpu(flash_model_t *m, uint32_t cycles);
+
+static inline double flash_model_us(const flash_model_t *m) {
+	return m->counters.cycles * 1000000.0 / FLASH_MODEL_CPU_HZ;
+}
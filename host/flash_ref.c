@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include "flash.h"
+#include "flash_ref.h"
+
+// the assembly counts status polls in a 16-bit register
+#define POLL_LIMIT 65536
+// flash_erase: 64 rounds of POLL_LIMIT
+#define ERASE_POLL_ROUNDS 64
+#define DQ5 0x20
+
+// approximate V30MZ instruction timings, excluding the bus access itself
+#define CYC_NOP 1
+#define CYC_MOV_MEM 1
+#define CYC_MOVSB 5
+#define CYC_CALL 5
+#define CYC_RET 6
+#define CYC_JCC_TAKEN 4
+#define CYC_JCC 1
+#define CYC_LOOP_TAKEN 5
+#define CYC_LOOP 2
+
+static void ref_cmd(flash_model_t *m, uint16_t addr, uint8_t value) {
+	flash_model_cpu(m, CYC_MOV_MEM);
+	flash_model_write(m, addr, value);
+}
+
+// _flash_write_busyloop: wait until two reads agree (DQ6 stops toggling);
+// false if DQ5 is set while still toggling, or after POLL_LIMIT polls
+static bool ref_busyloop(flash_model_t *m, uint16_t addr) {
+	flash_model_cpu(m, CYC_CALL + 1);
+	for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+		flash_model_cpu(m, 2 * CYC_NOP + CYC_MOV_MEM);
+		uint8_t a = flash_model_read(m, addr);
+		flash_model_cpu(m, 2 * CYC_NOP + CYC_MOV_MEM);
+		uint8_t b = flash_model_read(m, addr);
+		if (a == b) {
+			flash_model_cpu(m, CYC_JCC_TAKEN + 1 + CYC_RET);
+			return true;
+		}
+		flash_model_cpu(m, CYC_JCC + CYC_MOV_MEM);
+		if (flash_model_read(m, addr) & DQ5) {
+			// DQ5 may rise just as the program completes; look once more
+			flash_model_cpu(m, CYC_JCC_TAKEN + CYC_MOV_MEM);
+			a = flash_model_read(m, addr);
+			flash_model_cpu(m, CYC_MOV_MEM);
+			b = flash_model_read(m, addr);
+			flash_model_cpu(m, CYC_JCC_TAKEN + CYC_RET);
+			return a == b;
+		}
+		flash_model_cpu(m, CYC_JCC + 1 + CYC_JCC_TAKEN);
+	}
+	flash_model_cpu(m, CYC_JCC + 1 + CYC_RET);
+	return false;
+}
+
+// movsb from internal RAM: only the destination write reaches the cartridge
+static void ref_movsb(flash_model_t *m, uint16_t addr, uint8_t value) {
+	flash_model_cpu(m, CYC_MOVSB);
+	flash_model_write(m, addr, value);
+}
+
+static void ref_loop(flash_model_t *m, bool taken) {
+	flash_model_cpu(m, taken ? CYC_LOOP_TAKEN : CYC_LOOP);
+}
+
+static bool ref_write_slow(flash_model_t *m, const uint8_t *data, uint16_t offset, uint16_t len) {
+	for (uint16_t i = 0; i < len; i++) {
+		ref_cmd(m, 0xAAAA, 0xAA);
+		flash_model_cpu(m, CYC_NOP);
+		ref_cmd(m, 0x5555, 0x55);
+		flash_model_cpu(m, CYC_NOP);
+		ref_cmd(m, 0xAAAA, 0xA0);
+		flash_model_cpu(m, CYC_NOP);
+		ref_movsb(m, offset + i, data[i]);
+		if (!ref_busyloop(m, offset + i + 1)) {
+			ref_cmd(m, 0xAAAA, 0xF0);
+			return false;
+		}
+		ref_loop(m, i + 1 < len);
+	}
+	return true;
+}
+
+// WonderWitch and WSFM: one A0 per byte inside unlock bypass
+static bool ref_write_bypass(flash_model_t *m, const uint8_t *data, uint16_t offset, uint16_t len, bool wsfm) {
+	bool result = true;
+
+	ref_cmd(m, 0xAAAA, 0xAA);
+	ref_cmd(m, 0x5555, 0x55);
+	ref_cmd(m, 0xAAAA, 0x20);
+	for (uint16_t i = 0; i < len && result; i++) {
+		ref_cmd(m, 0x0000, 0xA0);
+		ref_movsb(m, offset + i, data[i]);
+		result = ref_busyloop(m, offset + i + 1);
+		ref_loop(m, i + 1 < len);
+	}
+	if (!result) {
+		// back to bypass mode from the failed program
+		ref_cmd(m, 0x0000, 0xF0);
+	}
+
+	ref_cmd(m, 0x0000, 0x90);
+	ref_cmd(m, 0x0000, wsfm ? 0x00 : 0xF0);
+	if (wsfm) {
+		ref_cmd(m, 0xAAAA, 0xAA);
+		ref_cmd(m, 0x5555, 0x55);
+		ref_cmd(m, 0xAAAA, 0xF0);
+	}
+	return result;
+}
+
+// MX29L: load the page with rep movsb, then poll the status register
+static bool ref_write_mx29l(flash_model_t *m, const uint8_t *data, uint16_t offset, uint16_t len) {
+	ref_cmd(m, 0xAAAA, 0xAA);
+	ref_cmd(m, 0x5555, 0x55);
+	ref_cmd(m, 0xAAAA, 0xA0);
+
+	for (uint16_t i = 0; i < len; i++) {
+		// rep movsb: about 2 cycles per byte plus the write
+		flash_model_cpu(m, 2);
+		flash_model_write(m, offset + i, data[i]);
+	}
+
+	// wait at least 100us
+	for (uint16_t i = 80; i > 0; i--) {
+		flash_model_cpu(m, CYC_NOP);
+		ref_loop(m, i > 1);
+	}
+
+	// the status register is only waited on; callers verify the data
+	bool result = false;
+	for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+		flash_model_cpu(m, CYC_MOV_MEM + 1);
+		if (flash_model_read(m, offset) & 0x80) {
+			flash_model_cpu(m, CYC_JCC);
+			result = true;
+			break;
+		}
+		flash_model_cpu(m, CYC_JCC_TAKEN);
+	}
+
+	ref_cmd(m, 0xAAAA, 0xAA);
+	ref_cmd(m, 0x5555, 0x55);
+	ref_cmd(m, 0xAAAA, 0xF0);
+	return result;
+}
+
+bool flash_ref_write(flash_model_t *m, const uint8_t *data, uint16_t offset, uint16_t len, uint16_t mode) {
+	switch (mode) {
+	case FLASH_MODE_FAST_MX29L:
+		return ref_write_mx29l(m, data, offset, len);
+	case FLASH_MODE_FAST_FLASHMASTA:
+		return ref_write_bypass(m, data, offset, len, true);
+	case FLASH_MODE_FAST_WONDERWITCH:
+		return ref_write_bypass(m, data, offset, len, false);
+	default:
+		return ref_write_slow(m, data, offset, len);
+	}
+}
+
+bool flash_ref_erase(flash_model_t *m, uint16_t offset, uint16_t mode) {
+	ref_cmd(m, 0xAAAA, 0xAA);
+	ref_cmd(m, 0x5555, 0x55);
+	ref_cmd(m, 0xAAAA, 0x80);
+	ref_cmd(m, 0xAAAA, 0xAA);
+	ref_cmd(m, 0x5555, 0x55);
+	ref_cmd(m, offset, 0x30);
+
+	// DQ2 and/or DQ6 toggle while erasing; DQ5 reports a failure
+	for (uint32_t i = 0; i < POLL_LIMIT * ERASE_POLL_ROUNDS; i++) {
+		flash_model_cpu(m, 3 * CYC_NOP + CYC_MOV_MEM);
+		uint8_t a = flash_model_read(m, offset);
+		flash_model_cpu(m, 3 * CYC_NOP + CYC_MOV_MEM);
+		if (a == flash_model_read(m, offset)) {
+			flash_model_cpu(m, CYC_JCC_TAKEN);
+			return true;
+		}
+		flash_model_cpu(m, CYC_JCC + CYC_MOV_MEM);
+		if (flash_model_read(m, offset) & DQ5) {
+			flash_model_cpu(m, CYC_JCC_TAKEN + CYC_MOV_MEM);
+			a = flash_model_read(m, offset);
+			flash_model_cpu(m, CYC_MOV_MEM);
+			if (a == flash_model_read(m, offset)) return true;
+			break;
+		}
+		flash_model_cpu(m, CYC_JCC + CYC_LOOP_TAKEN);
+	}
+	ref_cmd(m, offset, 0xF0);
+	return false;
+}
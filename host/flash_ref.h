@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flash_model.h"
+
+/**
+ * C reference versions of flash_write() and flash_erase() from
+ * src/flash.s, one per FLASH_MODE_*, driving a flash_model_t. They follow
+ * the assembly access for access, and charge approximate V30MZ cycle
+ * counts for the instructions in between.
+ *
+ * Like the assembly, status polling gives up on DQ5 or after a bounded
+ * number of reads, resetting the chip and returning false.
+ */
+
+bool flash_ref_write(flash_model_t *m, const uint8_t *data, uint16_t offset, uint16_t len, uint16_t mode);
+bool flash_ref_erase(flash_model_t *m, uint16_t offset, uint16_t mode);
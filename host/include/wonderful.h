@@ -0,0 +1,34 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Host stand-in for the Wonderful toolchain header: far pointers are plain
+ * pointers, and assembly calling convention helpers are unused.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define __far
+#define __wf_iram
+#define __wf_rom
+
+#define MK_FP(s, o) ((void*) (((uintptr_t) (s) << 4) + (uintptr_t) (o)))
+#define FP_SEG(p) ((uint16_t) ((uintptr_t) (p) >> 4))
+#define FP_OFF(p) ((uint16_t) ((uintptr_t) (p) & 0xF))
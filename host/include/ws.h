@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Host stand-in for libws: the subset used by the XMODEM engine and the
+ * transfer drivers. The serial port is backed by the link model in
+ * host/link.c or a pty; ports read back what was last written.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+
+void outportb(uint16_t port, uint8_t value);
+void outportw(uint16_t port, uint16_t value);
+uint8_t inportb(uint16_t port);
+uint16_t inportw(uint16_t port);
+
+static inline void cpu_irq_enable(void) {}
+static inline void cpu_irq_disable(void) {}
+static inline void cpu_halt(void) {}
+
+#define SERIAL_BAUD_9600 0
+#define SERIAL_BAUD_38400 1
+
+void ws_serial_open(uint8_t baud);
+void ws_serial_close(void);
+void ws_serial_putc(uint8_t value);
+uint8_t ws_serial_getc(void);
+int16_t ws_serial_getc_nonblock(void);
+
+static inline void ws_hwint_set_default_handler_serial_rx(void) {}
+static inline void ws_hwint_ack(uint8_t mask) {}
+
+#define IO_BANK_2003_RAM 0xD0
+#define IO_BANK_2003_ROM0 0xD2
+#define IO_BANK_RAM 0xC1
+#define IO_BANK_ROM0 0xC2
+#define IO_CART_FLASH 0xCE
+
+#define SCR_ENTRY_PALETTE(x) ((x) << 9)
+static inline void ws_screen_put_tile(void *screen, uint16_t tile, uint8_t x, uint8_t y) {}
+
+#define KEY_X1 0x0002
+#define KEY_X2 0x0004
+#define KEY_X3 0x0008
+#define KEY_X4 0x0010
+#define KEY_Y1 0x0020
+#define KEY_Y2 0x0040
+#define KEY_Y3 0x0080
+#define KEY_Y4 0x0100
+#define KEY_START 0x0200
+#define KEY_A 0x0400
+#define KEY_B 0x0800
+
+static inline uint16_t ws_keypad_scan(void) {
+	return 0;
+}
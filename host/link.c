@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "link.h"
+
+#define LINK_QUEUE_SIZE 65536
+
+typedef struct {
+	uint8_t data[LINK_QUEUE_SIZE];
+	double due[LINK_QUEUE_SIZE];
+	uint32_t head, tail;
+	double line_free;
+} link_queue_t;
+
+static link_config_t link_config;
+static link_queue_t link_queues[2];
+static link_counters_t link_stats;
+static int link_last_dir = -1;
+static pthread_mutex_t link_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t link_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int link_rand_state;
+
+double link_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void link_init(const link_config_t *config) {
+	pthread_mutex_lock(&link_mutex);
+	link_config = *config;
+	memset(link_queues, 0, sizeof(link_queues));
+	memset(&link_stats, 0, sizeof(link_stats));
+	link_last_dir = -1;
+	link_rand_state = config->seed;
+	pthread_mutex_unlock(&link_mutex);
+}
+
+static uint8_t link_corrupt(uint8_t value) {
+	if (link_config.bit_error_rate <= 0) return value;
+	for (uint8_t bit = 0; bit < 8; bit++) {
+		if ((double) rand_r(&link_rand_state) / RAND_MAX < link_config.bit_error_rate) {
+			value ^= 1 << bit;
+		}
+	}
+	return value;
+}
+
+void link_send(uint8_t dir, uint8_t value) {
+	pthread_mutex_lock(&link_mutex);
+	link_queue_t *q = &link_queues[dir];
+	double now = link_now_ms();
+	// start, data and stop bits
+	double byte_ms = 10000.0 / link_config.baud;
+	double start = q->line_free > now ? q->line_free : now;
+
+	q->line_free = start + byte_ms;
+	uint8_t sent = link_corrupt(value);
+	if (sent != value) link_stats.corrupted[dir]++;
+	link_stats.bytes[dir]++;
+	if (link_last_dir != dir) {
+		if (link_last_dir >= 0) link_stats.turnarounds++;
+		link_last_dir = dir;
+	}
+
+	if (q->tail - q->head < LINK_QUEUE_SIZE) {
+		q->data[q->tail % LINK_QUEUE_SIZE] = sent;
+		q->due[q->tail % LINK_QUEUE_SIZE] = q->line_free + link_config.latency_ms;
+		q->tail++;
+	}
+	pthread_cond_broadcast(&link_cond);
+	pthread_mutex_unlock(&link_mutex);
+}
+
+int link_recv(uint8_t dir, int timeout_ms) {
+	pthread_mutex_lock(&link_mutex);
+	link_queue_t *q = &link_queues[dir];
+	double deadline = link_now_ms() + timeout_ms;
+	int result = -1;
+
+	while (true) {
+		double now = link_now_ms();
+		if (q->head != q->tail && q->due[q->head % LINK_QUEUE_SIZE] <= now) {
+			result = q->data[q->head % LINK_QUEUE_SIZE];
+			q->head++;
+			break;
+		}
+		if (now >= deadline) break;
+
+		// sleep until the next byte is due, the deadline, or a new byte
+		double wake = deadline;
+		if (q->head != q->tail && q->due[q->head % LINK_QUEUE_SIZE] < wake) {
+			wake = q->due[q->head % LINK_QUEUE_SIZE];
+		}
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		double wait_ms = wake - now;
+		ts.tv_sec += (time_t) (wait_ms / 1000);
+		ts.tv_nsec += (long) (fmod(wait_ms, 1000) * 1000000);
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&link_cond, &link_mutex, &ts);
+	}
+	pthread_mutex_unlock(&link_mutex);
+	return result;
+}
+
+void link_wait_ready(uint8_t dir) {
+	pthread_mutex_lock(&link_mutex);
+	// one byte may be in the shift register while the next is written
+	double ready = link_queues[dir].line_free - 10000.0 / link_config.baud;
+	pthread_mutex_unlock(&link_mutex);
+
+	double wait_ms = ready - link_now_ms();
+	if (wait_ms > 0) {
+		struct timespec ts = {(time_t) (wait_ms / 1000), (long) (fmod(wait_ms, 1000) * 1000000)};
+		nanosleep(&ts, NULL);
+	}
+}
+
+void link_counters(link_counters_t *counters) {
+	pthread_mutex_lock(&link_mutex);
+	*counters = link_stats;
+	pthread_mutex_unlock(&link_mutex);
+}
+
+void link_reset_counters(void) {
+	pthread_mutex_lock(&link_mutex);
+	memset(&link_stats, 0, sizeof(link_stats));
+	link_last_dir = -1;
+	pthread_mutex_unlock(&link_mutex);
+}
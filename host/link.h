@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Simulated serial line between the device (the firmware's XMODEM code)
+ * and the host peer. Each direction delivers bytes at the line rate plus a
+ * fixed latency; bits are flipped at the configured error rate.
+ */
+
+#define LINK_TO_HOST 0
+#define LINK_TO_DEVICE 1
+
+typedef struct {
+	uint32_t baud;
+	double latency_ms;
+	// probability of each bit being flipped
+	double bit_error_rate;
+	uint32_t seed;
+} link_config_t;
+
+typedef struct {
+	uint64_t bytes[2];
+	uint64_t corrupted[2];
+	// direction changes on the line; two per request/response round trip
+	uint64_t turnarounds;
+} link_counters_t;
+
+void link_init(const link_config_t *config);
+void link_send(uint8_t dir, uint8_t value);
+// wait until the sender could write another byte, as when polling for transmit buffer empty
+void link_wait_ready(uint8_t dir);
+// returns -1 if nothing was delivered within timeout_ms
+int link_recv(uint8_t dir, int timeout_ms);
+void link_counters(link_counters_t *counters);
+void link_reset_counters(void);
+double link_now_ms(void);
@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "crc16.h"
+#include "link.h"
+#include "peer.h"
+
+#define SOH 1
+#define STX 2
+#define EOT 4
+#define ACK 6
+#define NAK 21
+#define CAN 24
+#define CRC 'C'
+
+#define PEER_TIMEOUT_MS 1000
+#define PEER_START_TIMEOUT_MS 10000
+#define PEER_RETRIES 10
+
+static void peer_putc(uint8_t value) {
+	link_send(LINK_TO_DEVICE, value);
+}
+
+static int peer_getc(int timeout_ms) {
+	return link_recv(LINK_TO_HOST, timeout_ms);
+}
+
+// wait for the line to go quiet before asking for a resend
+static void peer_purge(void) {
+	while (peer_getc(50) >= 0);
+}
+
+static void peer_read_stats(peer_session_t *s) {
+	static const char prefix[] = "WSBT-STATS ";
+	char line[sizeof(s->stats)];
+	size_t len = 0;
+	int c;
+
+	s->stats[0] = 0;
+	while ((c = peer_getc(500)) >= 0) {
+		if (c == '\r' || c == '\n') {
+			line[len] = 0;
+			if (!strncmp(line, prefix, sizeof(prefix) - 1)) {
+				strcpy(s->stats, line);
+				return;
+			}
+			len = 0;
+		} else if (len < sizeof(line) - 1) {
+			line[len++] = c;
+		}
+	}
+}
+
+void *peer_receive(void *arg) {
+	peer_session_t *s = arg;
+	uint8_t block[1024];
+	uint8_t idx = 1;
+	uint8_t errors = 0;
+	// 'C' only asks for the transfer to start; the device ignores it after
+	bool started = false;
+
+	s->ok = false;
+	s->transferred = 0;
+	peer_putc(CRC);
+	while (errors < PEER_RETRIES) {
+		int c = peer_getc(PEER_TIMEOUT_MS);
+		if (c == CAN) {
+			return NULL;
+		} else if (c == EOT) {
+			peer_putc(ACK);
+			peer_read_stats(s);
+			s->ok = true;
+			return NULL;
+		} else if (c == SOH || c == STX) {
+			uint16_t len = c == STX ? 1024 : 128;
+			started = true;
+			int b_idx = peer_getc(PEER_TIMEOUT_MS);
+			int b_idx_inv = peer_getc(PEER_TIMEOUT_MS);
+			uint16_t crc = 0;
+			bool complete = b_idx >= 0 && b_idx_inv >= 0;
+
+			for (uint16_t i = 0; complete && i < len; i++) {
+				int v = peer_getc(PEER_TIMEOUT_MS);
+				if (v < 0) complete = false;
+				block[i] = v;
+				crc = crc16_update(crc, v);
+			}
+			int hi = complete ? peer_getc(PEER_TIMEOUT_MS) : -1;
+			int lo = complete ? peer_getc(PEER_TIMEOUT_MS) : -1;
+			if (hi < 0 || lo < 0 || crc != ((hi << 8) | lo) || (b_idx ^ 0xFF) != b_idx_inv) {
+				if (hi < 0 || lo < 0) s->timeouts++;
+				s->naks++;
+				errors++;
+				peer_purge();
+				peer_putc(started ? NAK : CRC);
+			} else if (b_idx == idx) {
+				uint32_t copy = s->size - s->transferred;
+				if (copy > len) copy = len;
+				memcpy(s->data + s->transferred, block, copy);
+				s->transferred += copy;
+				idx++;
+				errors = 0;
+				peer_putc(ACK);
+			} else if (b_idx == (uint8_t) (idx - 1)) {
+				// our ACK got lost
+				peer_putc(ACK);
+			} else {
+				peer_putc(CAN);
+				return NULL;
+			}
+		} else if (c < 0) {
+			// a lost ACK leaves the sender waiting; prompt it again
+			s->timeouts++;
+			errors++;
+			peer_putc(started ? NAK : CRC);
+		}
+	}
+	return NULL;
+}
+
+static int peer_wait_response(void) {
+	while (true) {
+		int c = peer_getc(PEER_TIMEOUT_MS);
+		if (c < 0 || c == ACK || c == NAK || c == CAN || c == CRC) return c;
+		// corrupted responses are ignored, as by most terminal programs
+	}
+}
+
+void *peer_send(void *arg) {
+	peer_session_t *s = arg;
+	uint8_t block[1024];
+	uint8_t idx = 1;
+	int c;
+
+	s->ok = false;
+	s->transferred = 0;
+	do {
+		c = peer_getc(PEER_START_TIMEOUT_MS);
+		if (c < 0 || c == CAN) return NULL;
+	} while (c != CRC);
+
+	while (s->transferred < s->size) {
+		uint32_t remain = s->size - s->transferred;
+		uint16_t len = (s->use_1k && remain > 128) ? 1024 : 128;
+		uint16_t copy = remain < len ? remain : len;
+		uint8_t errors = 0;
+
+		memcpy(block, s->data + s->transferred, copy);
+		memset(block + copy, 0x1A, len - copy);
+		while (true) {
+			uint16_t crc = 0;
+			peer_putc(len == 1024 ? STX : SOH);
+			peer_putc(idx);
+			peer_putc(idx ^ 0xFF);
+			for (uint16_t i = 0; i < len; i++) {
+				peer_putc(block[i]);
+				crc = crc16_update(crc, block[i]);
+			}
+			peer_putc(crc >> 8);
+			peer_putc(crc);
+
+			c = peer_wait_response();
+			if (c == ACK) break;
+			if (c == CAN || ++errors >= PEER_RETRIES) return NULL;
+			if (c < 0) s->timeouts++; else s->naks++;
+		}
+		s->transferred += copy;
+		idx++;
+	}
+
+	for (uint8_t tries = 0; tries < PEER_RETRIES; tries++) {
+		peer_putc(EOT);
+		c = peer_wait_response();
+		if (c == ACK) {
+			peer_read_stats(s);
+			s->ok = true;
+			break;
+		}
+	}
+	return NULL;
+}
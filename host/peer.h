@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Host side of an XMODEM transfer over the simulated link, behaving like a
+ * typical terminal program: CRC-16, 1 KB blocks when sending, and a one
+ * second timeout on every response.
+ */
+
+typedef struct {
+	uint8_t *data;
+	uint32_t size;
+	bool use_1k;
+
+	// results
+	bool ok;
+	uint32_t transferred;
+	uint32_t naks;
+	uint32_t timeouts;
+	// the WSBT-STATS record sent by the device after the transfer
+	char stats[256];
+} peer_session_t;
+
+// pthread entry points; arg is a peer_session_t
+void *peer_receive(void *arg);
+void *peer_send(void *arg);
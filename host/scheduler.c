@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "scheduler.h"
+
+#define PROGRESS_INTERVAL_MS 250
+#define EVENTS_MAX 32
+
+static void scheduler_watch(int epfd, size_t i, session_t *s, bool *writing) {
+	bool pending = session_tx_pending(s) && !s->done;
+	if (pending == writing[i]) return;
+
+	struct epoll_event ev = {.events = EPOLLIN | (pending ? EPOLLOUT : 0), .data.u64 = i};
+	epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+	writing[i] = pending;
+}
+
+static void scheduler_draw(session_t *const *sessions, const char *const *names, size_t count, bool redraw) {
+	char line[160];
+
+	if (redraw) fprintf(stderr, "\033[%zuA", count);
+	for (size_t i = 0; i < count; i++) {
+		if (sessions[i]->done) {
+			snprintf(line, sizeof(line), "%s", sessions[i]->ok ? "done" : sessions[i]->error);
+		} else {
+			session_describe(sessions[i], line, sizeof(line));
+		}
+		fprintf(stderr, "\r\033[K%s: %s\n", names[i], line);
+	}
+}
+
+void scheduler_run(session_t *const *sessions, const char *const *names, size_t count, bool progress) {
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	bool *writing = calloc(count, sizeof(bool));
+	struct epoll_event events[EVENTS_MAX];
+	uint8_t buf[4096];
+	size_t active = 0;
+	bool drawn = false;
+	double next_progress = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct epoll_event ev = {.events = EPOLLIN, .data.u64 = i};
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, sessions[i]->fd, &ev) < 0) {
+			session_abort(sessions[i], "cannot watch the port");
+		}
+		if (!sessions[i]->done) active++;
+		scheduler_watch(epfd, i, sessions[i], writing);
+	}
+
+	while (active) {
+		double now = session_now();
+		double wait = next_progress - now;
+		if (!progress || wait > PROGRESS_INTERVAL_MS) wait = PROGRESS_INTERVAL_MS;
+		for (size_t i = 0; i < count; i++) {
+			if (!sessions[i]->done && session_deadline(sessions[i]) - now < wait) {
+				wait = session_deadline(sessions[i]) - now;
+			}
+		}
+		if (wait < 0) wait = 0;
+
+		int n = epoll_wait(epfd, events, EVENTS_MAX, (int) wait + 1);
+		if (n < 0 && errno != EINTR) break;
+		now = session_now();
+
+		for (int e = 0; e < n; e++) {
+			session_t *s = sessions[events[e].data.u64];
+			if (s->done) continue;
+			if (events[e].events & EPOLLIN) {
+				ssize_t r;
+				while ((r = read(s->fd, buf, sizeof(buf))) > 0) {
+					session_input(s, buf, r, now);
+				}
+			}
+			if (events[e].events & EPOLLOUT) {
+				session_tx_flush(s);
+			}
+			if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+				session_abort(s, "port closed");
+			}
+		}
+
+		// every session's clock is checked, not only those with traffic
+		active = 0;
+		for (size_t i = 0; i < count; i++) {
+			session_t *s = sessions[i];
+			if (s->done) continue;
+			session_timeout(s, now);
+			if (!s->done) active++;
+			scheduler_watch(epfd, i, s, writing);
+		}
+
+		if (progress && (now >= next_progress || !active)) {
+			next_progress = now + PROGRESS_INTERVAL_MS;
+			scheduler_draw(sessions, names, count, drawn);
+			drawn = true;
+		}
+	}
+
+	free(writing);
+	close(epfd);
+}
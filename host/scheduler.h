@@ -0,0 +1,30 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "session.h"
+
+/**
+ * Run sessions to completion from one epoll loop, one session per port.
+ * Sessions never block on each other: a slow or silent console only
+ * delays its own timeouts. With progress set, one status line per session
+ * is redrawn on stderr.
+ */
+void scheduler_run(session_t *const *sessions, const char *const *names, size_t count, bool progress);
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * libws serial functions backed by the simulated link (see link.h).
+ */
+
+#include <stdint.h>
+#include <ws.h>
+#include "link.h"
+
+// the real ws_serial_getc waits forever; give up eventually instead
+#define SERIAL_GETC_TIMEOUT_MS 10000
+
+void ws_serial_open(uint8_t baud) {
+}
+
+void ws_serial_close(void) {
+}
+
+void ws_serial_putc(uint8_t value) {
+	link_wait_ready(LINK_TO_HOST);
+	link_send(LINK_TO_HOST, value);
+}
+
+uint8_t ws_serial_getc(void) {
+	int r = link_recv(LINK_TO_DEVICE, SERIAL_GETC_TIMEOUT_MS);
+	return r < 0 ? 0 : r;
+}
+
+int16_t ws_serial_getc_nonblock(void) {
+	return link_recv(LINK_TO_DEVICE, 0);
+}
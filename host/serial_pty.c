@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * libws serial functions backed by a pty, for the device simulator.
+ */
+
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <ws.h>
+#include "serial_pty.h"
+
+// the real ws_serial_getc waits forever; give up eventually instead
+#define SERIAL_GETC_TIMEOUT_MS 10000
+
+int serial_pty_fd = -1;
+
+static uint8_t rx_buf[4096];
+static uint16_t rx_pos, rx_len;
+
+void ws_serial_open(uint8_t baud) {
+}
+
+void ws_serial_close(void) {
+}
+
+void ws_serial_putc(uint8_t value) {
+	while (write(serial_pty_fd, &value, 1) != 1) {
+		struct pollfd p = {serial_pty_fd, POLLOUT, 0};
+		poll(&p, 1, 10);
+	}
+}
+
+int16_t ws_serial_getc_nonblock(void) {
+	if (rx_pos == rx_len) {
+		ssize_t r = read(serial_pty_fd, rx_buf, sizeof(rx_buf));
+		if (r <= 0) return -1;
+		rx_pos = 0;
+		rx_len = r;
+	}
+	return rx_buf[rx_pos++];
+}
+
+uint8_t ws_serial_getc(void) {
+	int16_t r;
+	for (int i = 0; i < SERIAL_GETC_TIMEOUT_MS; i++) {
+		if ((r = ws_serial_getc_nonblock()) >= 0) return r;
+		struct pollfd p = {serial_pty_fd, POLLIN, 0};
+		poll(&p, 1, 1);
+	}
+	return 0;
+}
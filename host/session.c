@@ -0,0 +1,1028 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wonderful.h>
+#include "crc16.h"
+#include "session.h"
+#include "tty.h"
+#include "xmodem.h"
+
+#define SOH 1
+#define STX 2
+#define EOT 4
+#define ACK 6
+#define NAK 21
+#define CAN 24
+#define CRC 'C'
+
+// waiting for a response or the next byte of a block or frame
+#define SESSION_TIMEOUT_MS 1000
+// the device may be programming or erasing flash before it answers
+#define SESSION_ACK_TIMEOUT_MS 3000
+// a remote erase covers every sector of a bank
+#define SESSION_ERASE_TIMEOUT_MS 20000
+// the receiver asks the sender to start this often
+#define SESSION_START_INTERVAL_MS 3000
+// the device may erase flash before it asks for data
+#define SESSION_START_TIMEOUT_MS 600000
+#define SESSION_PURGE_MS 50
+#define SESSION_RETRIES 10
+#define SESSION_BANK_TRIES 3
+
+enum {
+	XR_START,
+	XR_IDLE,
+	XR_BLOCK,
+	XR_PURGE,
+	XS_START,
+	XS_WAIT_ACK,
+	XS_WAIT_EOT_ACK,
+	RM_WAIT_REPLY,
+	S_TRAILER,
+	S_ESCAPE,
+	S_DONE
+};
+
+enum {
+	RS_IDENTIFY,
+	RS_BAUD,
+	RS_CONFIG,
+	RS_ERASE,
+	RS_TRANSFER,
+	RS_CRC,
+	RS_EXIT
+};
+
+static const uint16_t rom_bank_values[] = {
+	2, 4, 8, 16, 32, 48, 64, 96, 128, 256, 512, 1024
+};
+
+double session_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void session_fail(session_t *s, const char *error) {
+	snprintf(s->error, sizeof(s->error), "%s", error);
+	s->state = S_DONE;
+	s->done = true;
+	s->ok = false;
+}
+
+static void session_succeed(session_t *s) {
+	s->state = S_DONE;
+	s->done = true;
+	s->ok = true;
+}
+
+static void session_put(session_t *s, const uint8_t *data, uint16_t len) {
+	while (len--) {
+		uint16_t next = (s->tx_tail + 1) % sizeof(s->tx);
+		if (next == s->tx_head) {
+			// a full queue means the port stopped draining
+			session_tx_flush(s);
+			if (next == s->tx_head) break;
+		}
+		s->tx[s->tx_tail] = *(data++);
+		s->tx_tail = next;
+	}
+}
+
+static void session_putc(session_t *s, uint8_t value) {
+	session_put(s, &value, 1);
+}
+
+bool session_tx_flush(session_t *s) {
+	while (s->tx_head != s->tx_tail) {
+		uint16_t end = s->tx_tail > s->tx_head ? s->tx_tail : sizeof(s->tx);
+		ssize_t r = write(s->fd, s->tx + s->tx_head, end - s->tx_head);
+		if (r < 0) {
+			return errno == EAGAIN || errno == EINTR;
+		}
+		s->tx_head = (s->tx_head + r) % sizeof(s->tx);
+	}
+	return true;
+}
+
+// time for the queued bytes to leave, plus timeout
+static double session_after_tx(const session_t *s, double now, double timeout) {
+	uint16_t queued = (s->tx_tail + sizeof(s->tx) - s->tx_head) % sizeof(s->tx);
+	return now + queued * 10000.0 / tty_rate_bps(s->rate) + timeout;
+}
+
+static void session_set_rate(session_t *s, uint8_t rate, double now) {
+	// the bytes already queued go out at the old rate
+	while (session_tx_pending(s) && session_tx_flush(s));
+	if (rate != s->rate) s->rate_changes++;
+	s->rate = rate;
+	s->rate_valid = now;
+	tty_set_rate(s->fd, rate);
+}
+
+static void session_rate_ok(session_t *s, double now) {
+	s->rate_valid = now;
+	s->rate_deadline = 0;
+}
+
+/**
+ * Nothing valid arrived in time. The device steps down on its own when an
+ * echo of its rate request is lost, so follow it after a second of silence.
+ */
+static void session_rate_silence(session_t *s, double now) {
+	if (s->rate > XMODEM_RATE_9600 && (now - s->rate_valid) >= SESSION_TIMEOUT_MS) {
+		session_set_rate(s, s->rate - 1, now);
+	}
+}
+
+static bool session_grow(session_t *s, uint32_t size) {
+	if (size <= s->capacity) return true;
+	uint32_t capacity = s->capacity ? s->capacity : 0x10000;
+	while (capacity < size) capacity <<= 1;
+	uint8_t *data = realloc(s->data, capacity);
+	if (data == NULL) return false;
+	memset(data + s->capacity, 0xFF, capacity - s->capacity);
+	s->data = data;
+	s->capacity = capacity;
+	return true;
+}
+
+static bool session_load(session_t *s, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	bool result = size > 0 && session_grow(s, size) && fread(s->data, 1, size, f) == (size_t) size;
+	s->size = size;
+	fclose(f);
+	return result;
+}
+
+// --- escape sequences (rate negotiation) ---
+
+static void session_state_deadline(session_t *s, double now);
+
+static void session_escape_end(session_t *s, double now) {
+	s->state = s->resume_state;
+	session_state_deadline(s, now);
+}
+
+// ESC 'P' and 16 probe bytes
+#define SESSION_ESC_PROBE_LEN 18
+// ESC 'H', the cartridge header and its CRC
+#define SESSION_ESC_HEADER_LEN 20
+
+static void session_sizes_reply(session_t *s) {
+	session_sizes_t sizes = {0};
+	uint8_t reply[6];
+
+	memcpy(s->header, s->esc + 2, 16);
+	s->identified = true;
+	if (s->config.sizes == NULL || !s->config.sizes(s->config.sizes_arg, s->header, &sizes)) {
+		memset(&sizes, 0, sizeof(sizes));
+	}
+	reply[0] = sizes.rom >> 16; reply[1] = sizes.rom >> 24;
+	reply[2] = sizes.sram >> 10; reply[3] = sizes.sram >> 18;
+	reply[4] = sizes.eeprom; reply[5] = sizes.eeprom >> 8;
+	uint16_t crc = crc16(reply, 6, 0);
+
+	session_putc(s, XMODEM_ESC);
+	session_putc(s, XMODEM_ESC_HEADER);
+	session_put(s, reply, 6);
+	session_putc(s, crc >> 8);
+	session_putc(s, crc);
+}
+
+static void session_escape_byte(session_t *s, uint8_t b, double now) {
+	s->esc[s->esc_len++] = b;
+	if (s->esc_len == 2 && b != XMODEM_ESC_RATE && b != XMODEM_ESC_PROBE && b != XMODEM_ESC_HEADER) {
+		session_escape_end(s, now);
+		return;
+	}
+	if (s->esc[1] == XMODEM_ESC_RATE && s->esc_len == 4) {
+		uint8_t rate = s->esc[2];
+		if (rate < XMODEM_RATE_COUNT && s->esc[3] == (rate ^ 0xFF)) {
+			session_put(s, s->esc, 4);
+			session_set_rate(s, rate, now);
+			// before a transfer, a probe follows at the new rate
+			if (!s->started && rate != XMODEM_RATE_9600) {
+				s->rate_deadline = now + SESSION_TIMEOUT_MS;
+			}
+		}
+		session_escape_end(s, now);
+	} else if (s->esc[1] == XMODEM_ESC_PROBE && s->esc_len == SESSION_ESC_PROBE_LEN) {
+		// the device compares the echo with what it sent
+		session_put(s, s->esc, SESSION_ESC_PROBE_LEN);
+		session_rate_ok(s, now);
+		session_escape_end(s, now);
+	} else if (s->esc[1] == XMODEM_ESC_HEADER && s->esc_len == SESSION_ESC_HEADER_LEN) {
+		// a damaged question goes unanswered; the device keeps its guess
+		if (crc16(s->esc + 2, 16, 0) == ((s->esc[18] << 8) | s->esc[19])) {
+			session_sizes_reply(s);
+			session_rate_ok(s, now);
+		}
+		session_escape_end(s, now);
+	}
+}
+
+static void session_escape_start(session_t *s, double now) {
+	s->resume_state = s->state;
+	s->state = S_ESCAPE;
+	s->esc[0] = XMODEM_ESC;
+	s->esc_len = 1;
+	s->deadline = now + SESSION_TIMEOUT_MS;
+}
+
+// --- text after a transfer ---
+
+static void session_trailer_byte(session_t *s, uint8_t b) {
+	static const char prefix[] = "WSBT-STATS ";
+
+	if (b == '\r' || b == '\n') {
+		s->text[s->text_len] = 0;
+		if (!strncmp(s->text, prefix, sizeof(prefix) - 1)) {
+			snprintf(s->stats, sizeof(s->stats), "%s", s->text);
+			session_succeed(s);
+		}
+		s->text_len = 0;
+	} else if (s->text_len < sizeof(s->text) - 1) {
+		s->text[s->text_len++] = b;
+	}
+}
+
+// --- XMODEM, receiving ---
+
+static void xr_request(session_t *s, double now) {
+	session_putc(s, s->started ? NAK : CRC);
+	s->state = s->started ? XR_IDLE : XR_START;
+	s->deadline = now + (s->started ? SESSION_TIMEOUT_MS : SESSION_START_INTERVAL_MS);
+}
+
+static void xr_block_done(session_t *s, double now) {
+	uint8_t idx = s->rx[0];
+	uint16_t crc = crc16(s->rx + 2, s->block_len, 0);
+	uint16_t crc_rx = (s->rx[s->block_len + 2] << 8) | s->rx[s->block_len + 3];
+
+	if ((idx ^ 0xFF) != s->rx[1] || crc != crc_rx) {
+		s->naks++;
+		if (++s->retries > SESSION_RETRIES) {
+			session_putc(s, CAN);
+			session_fail(s, "too many damaged blocks");
+			return;
+		}
+		s->state = XR_PURGE;
+		s->deadline = now + SESSION_PURGE_MS;
+		return;
+	}
+
+	session_rate_ok(s, now);
+	if (idx == s->idx) {
+		if (!session_grow(s, s->size + s->block_len)) {
+			session_putc(s, CAN);
+			session_fail(s, "out of memory");
+			return;
+		}
+		memcpy(s->data + s->size, s->rx + 2, s->block_len);
+		s->size += s->block_len;
+		s->idx++;
+		s->blocks++;
+		s->retries = 0;
+		session_putc(s, ACK);
+	} else if (idx == (uint8_t) (s->idx - 1)) {
+		// our ACK got lost
+		session_putc(s, ACK);
+	} else {
+		session_putc(s, CAN);
+		session_fail(s, "block out of sequence");
+		return;
+	}
+	s->state = XR_IDLE;
+	s->deadline = now + SESSION_TIMEOUT_MS;
+}
+
+static void xr_byte(session_t *s, uint8_t b, double now) {
+	switch (s->state) {
+	case XR_START:
+	case XR_IDLE:
+		if (b == SOH || b == STX) {
+			s->started = true;
+			s->block_len = b == STX ? XMODEM_BLOCK_SIZE_MAX : XMODEM_BLOCK_SIZE;
+			s->rx_len = 0;
+			s->rx_need = s->block_len + 4;
+			s->state = XR_BLOCK;
+			s->deadline = now + SESSION_TIMEOUT_MS;
+		} else if (b == EOT && s->started) {
+			session_putc(s, ACK);
+			s->state = S_TRAILER;
+			s->text_len = 0;
+			s->deadline = now + SESSION_TIMEOUT_MS;
+		} else if (b == CAN) {
+			session_fail(s, "cancelled by the device");
+		} else if (b == XMODEM_ESC) {
+			session_escape_start(s, now);
+		}
+		break;
+	case XR_BLOCK:
+		s->rx[s->rx_len++] = b;
+		s->deadline = now + SESSION_TIMEOUT_MS;
+		if (s->rx_len == s->rx_need) xr_block_done(s, now);
+		break;
+	case XR_PURGE:
+		s->deadline = now + SESSION_PURGE_MS;
+		break;
+	}
+}
+
+static void xr_timeout(session_t *s, double now) {
+	switch (s->state) {
+	case XR_START:
+		if (now >= s->rate_valid + SESSION_START_TIMEOUT_MS) {
+			session_fail(s, "the device did not start sending");
+			return;
+		}
+		xr_request(s, now);
+		break;
+	case XR_BLOCK:
+	case XR_IDLE:
+		s->timeouts++;
+		if (++s->retries > SESSION_RETRIES) {
+			session_fail(s, "the device stopped responding");
+			return;
+		}
+		session_rate_silence(s, now);
+		xr_request(s, now);
+		break;
+	case XR_PURGE:
+		xr_request(s, now);
+		break;
+	}
+}
+
+// --- XMODEM, sending ---
+
+static void xs_send_block(session_t *s, double now) {
+	uint32_t remain = s->size - s->offset;
+	uint16_t len = (s->crc && remain > XMODEM_BLOCK_SIZE) ? XMODEM_BLOCK_SIZE_MAX : XMODEM_BLOCK_SIZE;
+	uint8_t block[XMODEM_BLOCK_SIZE_MAX + 5];
+
+	block[0] = len == XMODEM_BLOCK_SIZE_MAX ? STX : SOH;
+	block[1] = s->idx;
+	block[2] = s->idx ^ 0xFF;
+	memset(block + 3, 0x1A, len);
+	memcpy(block + 3, s->data + s->offset, remain < len ? remain : len);
+	if (s->crc) {
+		uint16_t crc = crc16(block + 3, len, 0);
+		block[len + 3] = crc >> 8;
+		block[len + 4] = crc;
+	} else {
+		uint8_t sum = 0;
+		for (uint16_t i = 0; i < len; i++) sum += block[i + 3];
+		block[len + 3] = sum;
+	}
+	s->block_len = len;
+	session_put(s, block, len + (s->crc ? 5 : 4));
+	s->state = XS_WAIT_ACK;
+	s->deadline = session_after_tx(s, now, SESSION_ACK_TIMEOUT_MS);
+}
+
+static void xs_send_eot(session_t *s, double now) {
+	session_putc(s, EOT);
+	s->state = XS_WAIT_EOT_ACK;
+	s->deadline = now + SESSION_TIMEOUT_MS;
+}
+
+static void xs_retry(session_t *s, double now, bool timeout) {
+	if (timeout) s->timeouts++; else s->naks++;
+	if (++s->retries > SESSION_RETRIES) {
+		session_putc(s, CAN);
+		session_fail(s, "too many retries");
+		return;
+	}
+	if (timeout) session_rate_silence(s, now);
+	if (s->state == XS_WAIT_EOT_ACK) {
+		xs_send_eot(s, now);
+	} else {
+		xs_send_block(s, now);
+	}
+}
+
+static void xs_byte(session_t *s, uint8_t b, double now) {
+	if (b == CAN) {
+		session_fail(s, "cancelled by the device");
+		return;
+	} else if (b == XMODEM_ESC) {
+		session_escape_start(s, now);
+		return;
+	}
+
+	switch (s->state) {
+	case XS_START:
+		if (b == CRC || b == NAK) {
+			s->crc = b == CRC;
+			s->started = true;
+			session_rate_ok(s, now);
+			xs_send_block(s, now);
+		}
+		break;
+	case XS_WAIT_ACK:
+		if (b == ACK) {
+			session_rate_ok(s, now);
+			s->offset += s->block_len;
+			if (s->offset > s->size) s->offset = s->size;
+			s->idx++;
+			s->blocks++;
+			s->retries = 0;
+			if (s->offset < s->size) {
+				xs_send_block(s, now);
+			} else {
+				xs_send_eot(s, now);
+			}
+		} else if (b == NAK || (b == CRC && s->idx == 1)) {
+			xs_retry(s, now, false);
+		}
+		break;
+	case XS_WAIT_EOT_ACK:
+		if (b == ACK) {
+			s->state = S_TRAILER;
+			s->text_len = 0;
+			s->deadline = now + SESSION_TIMEOUT_MS;
+		} else if (b == NAK) {
+			xs_retry(s, now, false);
+		}
+		break;
+	}
+}
+
+static void xs_timeout(session_t *s, double now) {
+	if (s->state == XS_START) {
+		session_fail(s, "the device did not ask for data");
+	} else {
+		xs_retry(s, now, true);
+	}
+}
+
+// --- remote control ---
+
+static bool session_remote_writes(const session_t *s) {
+	return s->config.job != SESSION_REMOTE_BACKUP;
+}
+
+static uint32_t session_bank_size(const session_t *s) {
+	return s->config.space == REMOTE_SPACE_EEPROM ? s->size : 0x10000;
+}
+
+static uint32_t session_bank_offset(const session_t *s) {
+	return (uint32_t) s->bank * session_bank_size(s);
+}
+
+static uint32_t session_bank_len(const session_t *s) {
+	uint32_t left = s->size - session_bank_offset(s);
+	return left < session_bank_size(s) ? left : session_bank_size(s);
+}
+
+// device address of an offset in the image; images sit at the end of the bank space
+static uint32_t session_address(const session_t *s, uint8_t space, uint32_t offset) {
+	if (space == REMOTE_SPACE_EEPROM) return offset;
+	uint16_t bank = (uint16_t) (-s->banks + (offset >> 16));
+	return ((uint32_t) bank << 16) | (uint16_t) offset;
+}
+
+// crc16() takes 16-bit lengths; a whole bank is checksummed in halves, as the device does
+static uint16_t session_crc(const uint8_t *data, uint32_t len) {
+	uint16_t crc = 0;
+	for (uint32_t i = 0; i < len; i += 0x8000) {
+		crc = crc16(data + i, len - i < 0x8000 ? len - i : 0x8000, crc);
+	}
+	return crc;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+static void rm_send(session_t *s, double now) {
+	session_put(s, s->req, s->req_len);
+	s->state = RM_WAIT_REPLY;
+	s->rx_len = 0;
+	s->deadline = session_after_tx(s, now,
+		s->req[1] == REMOTE_CMD_ERASE ? SESSION_ERASE_TIMEOUT_MS : SESSION_ACK_TIMEOUT_MS);
+}
+
+static void rm_request(session_t *s, uint8_t cmd, const uint8_t *payload, uint16_t len, double now) {
+	uint8_t header[3] = {cmd, len, len >> 8};
+
+	s->req[0] = REMOTE_SYNC_REQUEST;
+	memcpy(s->req + 1, header, 3);
+	memcpy(s->req + 4, payload, len);
+	uint16_t crc = crc16(header, 3, crc16(payload, len, 0));
+	s->req[len + 4] = crc >> 8;
+	s->req[len + 5] = crc;
+	s->req_len = len + 6;
+	s->retries = 0;
+	rm_send(s, now);
+}
+
+static void rm_next(session_t *s, double now);
+
+static void rm_chunk(session_t *s, double now) {
+	uint32_t end = session_bank_offset(s) + session_bank_len(s);
+	uint16_t len = end - s->offset > XMODEM_BLOCK_SIZE_MAX ? XMODEM_BLOCK_SIZE_MAX : end - s->offset;
+	uint8_t payload[REMOTE_PAYLOAD_MAX];
+	uint8_t space = s->config.space;
+
+	payload[0] = space;
+	put32(payload + 1, session_address(s, space, s->offset));
+	if (session_remote_writes(s)) {
+		memcpy(payload + 5, s->data + s->offset, len);
+		rm_request(s, REMOTE_CMD_WRITE, payload, len + 5, now);
+	} else {
+		put16(payload + 5, len);
+		rm_request(s, REMOTE_CMD_READ, payload, 7, now);
+	}
+	s->block_len = len;
+}
+
+static void rm_crc(session_t *s, double now) {
+	// flash is read back through the ROM window
+	uint8_t payload[9];
+	uint8_t space = s->config.space == REMOTE_SPACE_FLASH ? REMOTE_SPACE_ROM : s->config.space;
+	payload[0] = space;
+	put32(payload + 1, session_address(s, space, session_bank_offset(s)));
+	put32(payload + 5, session_bank_len(s));
+	s->step = RS_CRC;
+	rm_request(s, REMOTE_CMD_CRC, payload, 9, now);
+}
+
+static void rm_bank_start(session_t *s, double now) {
+	s->offset = session_bank_offset(s);
+	s->probe = s->known && s->bank_tries == 0;
+	if (s->probe) {
+		rm_crc(s, now);
+	} else if (s->config.job == SESSION_REMOTE_FLASH) {
+		uint8_t payload[4];
+		put32(payload, session_address(s, REMOTE_SPACE_FLASH, s->offset));
+		s->step = RS_ERASE;
+		rm_request(s, REMOTE_CMD_ERASE, payload, 4, now);
+	} else {
+		s->step = RS_TRANSFER;
+		rm_chunk(s, now);
+	}
+}
+
+// redo only this bank; a flash bank is erased again first
+static void rm_bank_retry(session_t *s, const char *reason, double now) {
+	s->bank_retries++;
+	if (++s->bank_tries >= SESSION_BANK_TRIES) {
+		session_fail(s, reason);
+		return;
+	}
+	rm_bank_start(s, now);
+}
+
+static void rm_next(session_t *s, double now) {
+	switch (s->step) {
+	case RS_BAUD:
+		if (s->config.flash_mode || s->config.job == SESSION_REMOTE_FLASH) {
+			// 3 cycle wait states while programming
+			uint8_t payload[2] = {0x08, s->config.flash_mode};
+			s->step = RS_CONFIG;
+			rm_request(s, REMOTE_CMD_CONFIG, payload, 2, now);
+			break;
+		}
+		// fall through
+	case RS_CONFIG:
+		s->bank = 0;
+		s->bank_tries = 0;
+		rm_bank_start(s, now);
+		break;
+	case RS_ERASE:
+		s->step = RS_TRANSFER;
+		rm_chunk(s, now);
+		break;
+	case RS_TRANSFER:
+		if (s->offset < session_bank_offset(s) + session_bank_len(s)) {
+			rm_chunk(s, now);
+		} else {
+			rm_crc(s, now);
+		}
+		break;
+	case RS_CRC:
+		if ((uint32_t) (s->bank + 1) * session_bank_size(s) < s->size) {
+			s->bank++;
+			s->bank_tries = 0;
+			rm_bank_start(s, now);
+		} else {
+			s->step = RS_EXIT;
+			rm_request(s, REMOTE_CMD_EXIT, NULL, 0, now);
+		}
+		break;
+	}
+}
+
+static bool rm_size_from_database(session_t *s) {
+	session_sizes_t sizes;
+	if (s->config.sizes == NULL || !s->config.sizes(s->config.sizes_arg, s->header, &sizes)) {
+		return false;
+	}
+	switch (s->config.space) {
+	case REMOTE_SPACE_ROM: s->size = sizes.rom; break;
+	case REMOTE_SPACE_SRAM: s->size = sizes.sram; break;
+	case REMOTE_SPACE_EEPROM: s->size = sizes.eeprom; break;
+	}
+	// 0 if the cartridge has none of this memory; the header cannot know better
+	return true;
+}
+
+static bool rm_size_from_header(session_t *s) {
+	uint8_t rom = s->header[0xA];
+	uint8_t save = s->header[0xB];
+
+	switch (s->config.space) {
+	case REMOTE_SPACE_ROM:
+		if (rom >= sizeof(rom_bank_values) / sizeof(*rom_bank_values)) return false;
+		s->size = (uint32_t) rom_bank_values[rom] << 16;
+		return true;
+	case REMOTE_SPACE_SRAM:
+		switch (save) {
+		case 0x01: case 0x02: s->size = 32 << 10; return true;
+		case 0x03: s->size = 128 << 10; return true;
+		case 0x04: s->size = 256 << 10; return true;
+		case 0x05: s->size = 512 << 10; return true;
+		}
+		return false;
+	case REMOTE_SPACE_EEPROM:
+		switch (save) {
+		case 0x10: s->size = 128; return true;
+		case 0x20: s->size = 2048; return true;
+		case 0x50: s->size = 1024; return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+static void rm_reply(session_t *s, uint8_t cmd, uint8_t status, const uint8_t *payload, uint16_t len, double now) {
+	if (cmd != s->req[1]) {
+		// a late reply to a resent request
+		return;
+	}
+	if (status == REMOTE_ERROR_CRC) {
+		s->naks++;
+		if (++s->retries > SESSION_RETRIES) {
+			session_fail(s, "too many damaged requests");
+		} else {
+			rm_send(s, now);
+		}
+		return;
+	}
+	if (status == REMOTE_ERROR_FAILED && s->config.job == SESSION_REMOTE_FLASH
+		&& (s->step == RS_ERASE || s->step == RS_TRANSFER)) {
+		// the chip reported a failed erase or program
+		rm_bank_retry(s, "flash failed after retries", now);
+		return;
+	}
+	if (status != REMOTE_OK) {
+		static const char *const errors[] = {
+			"", "", "command not supported by the device",
+			"request rejected by the device", "the device could not carry out a request"
+		};
+		session_fail(s, status < 5 ? errors[status] : "unknown error");
+		return;
+	}
+	session_rate_ok(s, now);
+
+	switch (s->step) {
+	case RS_IDENTIFY:
+		if (len < 17 || payload[0] != REMOTE_VERSION) {
+			session_fail(s, "unsupported remote protocol version");
+			return;
+		}
+		memcpy(s->header, payload + 1, 16);
+		s->identified = true;
+		if (!s->size && !rm_size_from_database(s) && !rm_size_from_header(s)) {
+			session_fail(s, "size unknown; the header does not say");
+			return;
+		}
+		if (!s->size) {
+			session_fail(s, "the cartridge database lists none of this memory");
+			return;
+		}
+		if (!session_grow(s, s->size)) {
+			session_fail(s, "out of memory");
+			return;
+		}
+		s->banks = (s->size + 0xFFFF) >> 16;
+		// saves change between dumps and a CRC-16 is too weak to tell a
+		// changed bank from an unchanged one; a ROM with the same header only
+		// has to be confirmed
+		if (s->config.lookup && s->config.space == REMOTE_SPACE_ROM) {
+			uint8_t *known;
+			uint32_t known_size;
+			if (s->config.lookup(s->config.lookup_arg, s->header, &known, &known_size)) {
+				if (known_size == s->size) {
+					memcpy(s->data, known, s->size);
+					s->known = true;
+				}
+				free(known);
+			}
+		}
+		s->step = RS_BAUD;
+		if (s->config.rate != s->rate) {
+			uint8_t rate = s->config.rate;
+			rm_request(s, REMOTE_CMD_BAUD, &rate, 1, now);
+			return;
+		}
+		rm_next(s, now);
+		break;
+	case RS_BAUD:
+		// the reply came at the old rate
+		session_set_rate(s, s->config.rate, now);
+		rm_next(s, now);
+		break;
+	case RS_TRANSFER:
+		if (!session_remote_writes(s)) {
+			if (len != s->block_len) {
+				session_fail(s, "short read");
+				return;
+			}
+			memcpy(s->data + s->offset, payload, len);
+		}
+		s->offset += s->block_len;
+		s->blocks++;
+		rm_next(s, now);
+		break;
+	case RS_CRC: {
+		uint16_t crc = session_crc(s->data + session_bank_offset(s), session_bank_len(s));
+		bool match = len == 2 && ((payload[0] << 8) | payload[1]) == crc;
+		if (s->probe) {
+			s->probe = false;
+			if (match) {
+				s->offset = session_bank_offset(s) + session_bank_len(s);
+				s->banks_reused++;
+				rm_next(s, now);
+			} else {
+				s->step = RS_TRANSFER;
+				rm_chunk(s, now);
+			}
+			return;
+		}
+		if (!match) {
+			rm_bank_retry(s, "checksum mismatch after retries", now);
+			return;
+		}
+		rm_next(s, now);
+	} break;
+	case RS_EXIT:
+		session_succeed(s);
+		break;
+	default:
+		rm_next(s, now);
+		break;
+	}
+}
+
+static void rm_byte(session_t *s, uint8_t b, double now) {
+	if (s->rx_len == 0 && b != REMOTE_SYNC_REPLY) return;
+	s->rx[s->rx_len++] = b;
+	if (s->rx_len == 5) {
+		uint16_t len = s->rx[3] | (s->rx[4] << 8);
+		if (len > REMOTE_PAYLOAD_MAX) {
+			s->rx_len = 0;
+			return;
+		}
+		s->rx_need = len + 7;
+	}
+	if (s->rx_len < 5 || s->rx_len < s->rx_need) return;
+
+	uint16_t len = s->rx_need - 7;
+	uint16_t crc = crc16(s->rx + 1, 4, crc16(s->rx + 5, len, 0));
+	s->rx_len = 0;
+	if (crc != ((s->rx[len + 5] << 8) | s->rx[len + 6])) {
+		// resend once the line is quiet
+		s->naks++;
+		s->deadline = now + SESSION_PURGE_MS;
+		return;
+	}
+	rm_reply(s, s->rx[1], s->rx[2], s->rx + 5, len, now);
+}
+
+static void rm_timeout(session_t *s, double now) {
+	s->timeouts++;
+	if (++s->retries > SESSION_RETRIES) {
+		session_fail(s, "the device stopped responding");
+		return;
+	}
+	session_rate_silence(s, now);
+	rm_send(s, now);
+}
+
+// --- common ---
+
+static void session_state_deadline(session_t *s, double now) {
+	switch (s->state) {
+	case XR_START:
+		s->deadline = now + SESSION_START_INTERVAL_MS;
+		break;
+	case XS_START:
+		s->deadline = now + SESSION_START_TIMEOUT_MS;
+		break;
+	case XS_WAIT_ACK:
+	case RM_WAIT_REPLY:
+		s->deadline = session_after_tx(s, now, SESSION_ACK_TIMEOUT_MS);
+		break;
+	default:
+		s->deadline = now + SESSION_TIMEOUT_MS;
+		break;
+	}
+}
+
+bool session_init(session_t *s, const session_config_t *config, int fd, double now) {
+	memset(s, 0, sizeof(*s));
+	s->config = *config;
+	s->fd = fd;
+	s->rate = XMODEM_RATE_9600;
+	s->rate_valid = now;
+	s->idx = 1;
+
+	switch (config->job) {
+	case SESSION_XMODEM_RECV:
+		xr_request(s, now);
+		break;
+	case SESSION_XMODEM_SEND:
+		if (!session_load(s, config->path)) {
+			snprintf(s->error, sizeof(s->error), "cannot read %s", config->path);
+			return false;
+		}
+		s->state = XS_START;
+		s->deadline = now + SESSION_START_TIMEOUT_MS;
+		break;
+	case SESSION_REMOTE_RESTORE:
+	case SESSION_REMOTE_FLASH:
+		if (!session_load(s, config->path)) {
+			snprintf(s->error, sizeof(s->error), "cannot read %s", config->path);
+			return false;
+		}
+		if (config->job == SESSION_REMOTE_FLASH && (s->size & 0xFFFF)) {
+			snprintf(s->error, sizeof(s->error), "flash images must be whole 64 KB banks");
+			return false;
+		}
+		s->config.space = config->job == SESSION_REMOTE_FLASH ? REMOTE_SPACE_FLASH : config->space;
+		// fall through
+	case SESSION_REMOTE_BACKUP:
+		if (config->job == SESSION_REMOTE_BACKUP) s->size = config->size;
+		s->step = RS_IDENTIFY;
+		rm_request(s, REMOTE_CMD_IDENTIFY, NULL, 0, now);
+		break;
+	}
+	return true;
+}
+
+void session_free(session_t *s) {
+	free(s->data);
+	s->data = NULL;
+}
+
+void session_abort(session_t *s, const char *error) {
+	session_fail(s, error);
+}
+
+void session_input(session_t *s, const uint8_t *data, size_t len, double now) {
+	for (size_t i = 0; i < len && !s->done; i++) {
+		uint8_t b = data[i];
+		switch (s->state) {
+		case S_ESCAPE:
+			session_escape_byte(s, b, now);
+			break;
+		case S_TRAILER:
+			session_trailer_byte(s, b);
+			break;
+		case RM_WAIT_REPLY:
+			rm_byte(s, b, now);
+			break;
+		case XS_START:
+		case XS_WAIT_ACK:
+		case XS_WAIT_EOT_ACK:
+			xs_byte(s, b, now);
+			break;
+		default:
+			xr_byte(s, b, now);
+			break;
+		}
+	}
+	session_tx_flush(s);
+}
+
+void session_timeout(session_t *s, double now) {
+	if (s->done) return;
+	if (s->rate_deadline && now >= s->rate_deadline) {
+		// the probe never came; the device went back to 9600 bps
+		s->rate_deadline = 0;
+		session_set_rate(s, XMODEM_RATE_9600, now);
+	}
+	if (now < s->deadline) return;
+
+	switch (s->state) {
+	case S_ESCAPE:
+		session_escape_end(s, now);
+		break;
+	case S_TRAILER:
+		// plain XMODEM senders have nothing to add
+		session_succeed(s);
+		break;
+	case RM_WAIT_REPLY:
+		rm_timeout(s, now);
+		break;
+	case XS_START:
+	case XS_WAIT_ACK:
+	case XS_WAIT_EOT_ACK:
+		xs_timeout(s, now);
+		break;
+	default:
+		xr_timeout(s, now);
+		break;
+	}
+	session_tx_flush(s);
+}
+
+double session_deadline(const session_t *s) {
+	if (s->rate_deadline && s->rate_deadline < s->deadline) return s->rate_deadline;
+	return s->deadline;
+}
+
+static const char *const session_job_names[] = {
+	"receive", "send", "backup", "restore", "flash"
+};
+
+void session_describe(const session_t *s, char *buf, size_t len) {
+	uint32_t done = s->config.job == SESSION_XMODEM_RECV ? s->size : s->offset;
+
+	if (s->size && s->config.job != SESSION_XMODEM_RECV) {
+		snprintf(buf, len, "%s %u/%u KB, %u bps, %u NAK, %u timeouts",
+			session_job_names[s->config.job], done >> 10, s->size >> 10,
+			tty_rate_bps(s->rate), s->naks, s->timeouts);
+	} else {
+		snprintf(buf, len, "%s %u KB, %u bps, %u NAK, %u timeouts",
+			session_job_names[s->config.job], done >> 10,
+			tty_rate_bps(s->rate), s->naks, s->timeouts);
+	}
+}
+
+int session_rom_checksum(const uint8_t *data, uint32_t size) {
+	if (size < 0x10000 || (size & 0xFFFF)) return -1;
+	uint16_t sum = 0;
+	for (uint32_t i = 0; i < size - 2; i++) {
+		sum += data[i];
+	}
+	return sum == (data[size - 2] | (data[size - 1] << 8));
+}
+
+bool session_finish(session_t *s) {
+	if (!s->ok || s->config.job == SESSION_XMODEM_SEND
+		|| s->config.job == SESSION_REMOTE_RESTORE || s->config.job == SESSION_REMOTE_FLASH) {
+		return s->ok;
+	}
+	if (s->config.size && s->config.size < s->size) {
+		s->size = s->config.size;
+	}
+
+	// only replace the file once the whole dump is in
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.part", s->config.path);
+	FILE *f = fopen(tmp, "wb");
+	bool result = f != NULL && fwrite(s->data, 1, s->size, f) == s->size;
+	if (f != NULL && fclose(f)) result = false;
+	if (result && rename(tmp, s->config.path)) result = false;
+	if (!result) {
+		unlink(tmp);
+		snprintf(s->error, sizeof(s->error), "cannot write %s", s->config.path);
+		s->ok = false;
+	}
+	return s->ok;
+}
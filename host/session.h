@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "remote.h"
+
+/**
+ * One companion tool job on one serial port.
+ *
+ * Sessions are event driven: the owner feeds received bytes to
+ * session_input(), writes out session_tx_*() when the port is writable,
+ * and calls session_timeout() once session_deadline() has passed. Times
+ * are in milliseconds, see session_now().
+ */
+
+typedef enum {
+	// the device sends, from its backup menu
+	SESSION_XMODEM_RECV,
+	// the device receives, for a restore or flash write from its menu
+	SESSION_XMODEM_SEND,
+	// the tool drives the device in remote control mode
+	SESSION_REMOTE_BACKUP,
+	SESSION_REMOTE_RESTORE,
+	SESSION_REMOTE_FLASH
+} session_job_t;
+
+typedef struct {
+	// bytes
+	uint32_t rom;
+	uint32_t sram;
+	uint32_t eeprom;
+} session_sizes_t;
+
+typedef struct {
+	session_job_t job;
+	// file written by receiving jobs, read by sending jobs
+	const char *path;
+	// remote: REMOTE_SPACE_*
+	uint8_t space;
+	// bytes; for backups, 0 takes the size from the cartridge header
+	// (remote) or from the transfer (XMODEM)
+	uint32_t size;
+	// remote: line rate to switch to, XMODEM_RATE_*
+	uint8_t rate;
+	// remote: FLASH_MODE_*
+	uint8_t flash_mode;
+	/**
+	 * Remote ROM backups: an earlier dump of the cartridge, looked up once
+	 * the device has sent its header. Banks whose CRC still matches are
+	 * taken from it instead of being read again. *data is freed by the
+	 * session.
+	 */
+	bool (*lookup)(void *arg, const uint8_t header[16], uint8_t **data, uint32_t *size);
+	void *lookup_arg;
+	/**
+	 * Exact sizes of a cartridge, from a database. Answers the device's
+	 * question before a backup from its menu, and sizes remote backups
+	 * in place of the header.
+	 */
+	bool (*sizes)(void *arg, const uint8_t header[16], session_sizes_t *sizes);
+	void *sizes_arg;
+} session_config_t;
+
+typedef struct {
+	session_config_t config;
+	int fd;
+
+	uint8_t state;
+	uint8_t resume_state;
+	double deadline;
+	uint8_t rate;
+	// last byte that proved the current rate works
+	double rate_valid;
+	// during rate negotiation: fall back to 9600 bps unless confirmed by then
+	double rate_deadline;
+
+	uint8_t *data;
+	uint32_t size;
+	uint32_t capacity;
+	uint32_t offset;
+
+	uint8_t rx[REMOTE_PAYLOAD_MAX + 8];
+	uint16_t rx_len, rx_need;
+	uint8_t esc[20];
+	uint8_t esc_len;
+
+	uint8_t tx[8192];
+	uint16_t tx_head, tx_tail;
+
+	// XMODEM
+	uint8_t idx;
+	bool crc;
+	bool started;
+	uint16_t block_len;
+	uint8_t retries;
+
+	// remote control
+	uint8_t step;
+	uint8_t req[REMOTE_PAYLOAD_MAX + 7];
+	uint16_t req_len;
+	// remote: from IDENTIFY; XMODEM: from the device's size question
+	uint8_t header[16];
+	bool identified;
+	uint16_t banks;
+	uint16_t bank;
+	uint8_t bank_tries;
+	// data holds an earlier dump; check each bank's CRC before reading it
+	bool known;
+	bool probe;
+
+	char text[256];
+	uint16_t text_len;
+	// the WSBT-STATS record sent by the device after a transfer
+	char stats[256];
+
+	uint32_t blocks, naks, timeouts, rate_changes, bank_retries, banks_reused;
+	bool done, ok;
+	char error[128];
+} session_t;
+
+double session_now(void);
+
+// returns false with s->error set if the job cannot start
+bool session_init(session_t *s, const session_config_t *config, int fd, double now);
+void session_free(session_t *s);
+// stop the session, failed with error
+void session_abort(session_t *s, const char *error);
+
+void session_input(session_t *s, const uint8_t *data, size_t len, double now);
+void session_timeout(session_t *s, double now);
+double session_deadline(const session_t *s);
+
+static inline bool session_tx_pending(const session_t *s) {
+	return s->tx_head != s->tx_tail;
+}
+// write queued bytes to the port; false on a write error
+bool session_tx_flush(session_t *s);
+
+// one line of progress, without a newline
+void session_describe(const session_t *s, char *buf, size_t len);
+
+// check the result and, for receiving jobs, write it to config.path
+bool session_finish(session_t *s);
+
+/**
+ * Compare the checksum in the header at the end of a ROM image with its
+ * contents. Returns 1 if it matches, 0 if not, -1 if data is not a whole
+ * ROM image.
+ */
+int session_rom_checksum(const uint8_t *data, uint32_t size);
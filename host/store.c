@@ -0,0 +1,273 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "store.h"
+
+#define STORE_MANIFEST_MAGIC "wsbt-store 1"
+#define STORE_CHUNKS_MAX 1024
+
+typedef struct {
+	uint32_t size;
+	uint8_t header[16];
+	uint16_t count;
+	uint8_t hash[STORE_CHUNKS_MAX][SHA256_SIZE];
+} store_manifest_t;
+
+static bool store_mkdir(const char *path) {
+	return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+static void store_hex(char *out, const uint8_t *data, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		sprintf(out + i * 2, "%02x", data[i]);
+	}
+}
+
+static bool store_unhex(uint8_t *out, const char *hex, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		unsigned int v;
+		if (sscanf(hex + i * 2, "%2x", &v) != 1) return false;
+		out[i] = v;
+	}
+	return true;
+}
+
+static void store_chunk_path(const store_t *st, const uint8_t hash[SHA256_SIZE], char *path, size_t len) {
+	char hex[SHA256_SIZE * 2 + 1];
+	store_hex(hex, hash, SHA256_SIZE);
+	snprintf(path, len, "%s/objects/%.2s/%s", st->root, hex, hex + 2);
+}
+
+// write through a temporary file, so a crash never leaves a partial object
+static bool store_write_file(const char *path, const void *data, size_t len) {
+	char tmp[4200];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *f = fopen(tmp, "wb");
+	bool result = f != NULL && fwrite(data, 1, len, f) == len;
+	if (f != NULL && fclose(f)) result = false;
+	if (result && rename(tmp, path)) result = false;
+	if (!result) unlink(tmp);
+	return result;
+}
+
+bool store_open(store_t *st, const char *root) {
+	char path[4200];
+	snprintf(st->root, sizeof(st->root), "%s", root);
+	snprintf(path, sizeof(path), "%s/objects", root);
+	if (!store_mkdir(root) || !store_mkdir(path)) return false;
+	snprintf(path, sizeof(path), "%s/carts", root);
+	return store_mkdir(path);
+}
+
+void store_key(const uint8_t header[16], char key[STORE_KEY_LEN]) {
+	snprintf(key, STORE_KEY_LEN, "%02x-%02x%02x-%02x-%04x",
+		header[6], header[7], header[8], header[9], header[0xE] | (header[0xF] << 8));
+}
+
+// highest manifest revision of kind for key, 0 if none
+static uint32_t store_latest(const store_t *st, const char *key, const char *kind) {
+	char path[4200];
+	size_t kind_len = strlen(kind);
+	uint32_t latest = 0;
+
+	snprintf(path, sizeof(path), "%s/carts/%s", st->root, key);
+	DIR *dir = opendir(path);
+	if (dir == NULL) return 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, kind, kind_len) || entry->d_name[kind_len] != '-') continue;
+		char *end;
+		uint32_t revision = strtoul(entry->d_name + kind_len + 1, &end, 10);
+		if (*end == 0 && revision > latest) latest = revision;
+	}
+	closedir(dir);
+	return latest;
+}
+
+static void store_manifest_path(const store_t *st, const char *key, const char *kind,
+	uint32_t revision, char *path, size_t len) {
+
+	snprintf(path, len, "%s/carts/%s/%s-%04" PRIu32, st->root, key, kind, revision);
+}
+
+static bool store_read_manifest(const char *path, store_manifest_t *m) {
+	char line[256], hex[SHA256_SIZE * 2 + 1];
+	FILE *f = fopen(path, "r");
+	if (f == NULL) return false;
+
+	bool result = fgets(line, sizeof(line), f) && !strncmp(line, STORE_MANIFEST_MAGIC, strlen(STORE_MANIFEST_MAGIC));
+	m->size = 0;
+	m->count = 0;
+	while (result && fgets(line, sizeof(line), f)) {
+		char hex_header[33];
+		if (sscanf(line, "size %" SCNu32, &m->size) == 1) continue;
+		if (sscanf(line, "header %32s", hex_header) == 1) {
+			result = store_unhex(m->header, hex_header, 16);
+		} else if (sscanf(line, "chunk %64s", hex) == 1) {
+			result = m->count < STORE_CHUNKS_MAX && store_unhex(m->hash[m->count++], hex, SHA256_SIZE);
+		}
+	}
+	fclose(f);
+	return result && m->count == (m->size + STORE_CHUNK_SIZE - 1) / STORE_CHUNK_SIZE;
+}
+
+static bool store_write_manifest(const char *path, const char *kind, const store_manifest_t *m) {
+	size_t len = 0, capacity = 128 + m->count * (SHA256_SIZE * 2 + 8);
+	char *text = malloc(capacity);
+	char hex[SHA256_SIZE * 2 + 1];
+	if (text == NULL) return false;
+
+	store_hex(hex, m->header, 16);
+	len += sprintf(text + len, STORE_MANIFEST_MAGIC "\nkind %s\nsize %" PRIu32 "\nheader %s\n", kind, m->size, hex);
+	for (uint16_t i = 0; i < m->count; i++) {
+		store_hex(hex, m->hash[i], SHA256_SIZE);
+		len += sprintf(text + len, "chunk %s\n", hex);
+	}
+	bool result = store_write_file(path, text, len);
+	free(text);
+	return result;
+}
+
+bool store_put(store_t *st, const uint8_t header[16], const char *kind,
+	const uint8_t *data, uint32_t size, store_result_t *result) {
+
+	char key[STORE_KEY_LEN], path[4200];
+	store_manifest_t *m = calloc(2, sizeof(store_manifest_t));
+	store_manifest_t *latest = m + 1;
+	bool ok = false;
+
+	memset(result, 0, sizeof(*result));
+	if (m == NULL) return false;
+	if (size == 0 || size > STORE_CHUNK_SIZE * STORE_CHUNKS_MAX) goto done;
+
+	store_key(header, key);
+	m->size = size;
+	memcpy(m->header, header, 16);
+	for (uint32_t offset = 0; offset < size; offset += STORE_CHUNK_SIZE) {
+		uint32_t len = size - offset < STORE_CHUNK_SIZE ? size - offset : STORE_CHUNK_SIZE;
+		uint8_t *hash = m->hash[m->count++];
+		sha256(data + offset, len, hash);
+
+		store_chunk_path(st, hash, path, sizeof(path));
+		if (access(path, F_OK) == 0) continue;
+		// objects/ab
+		*strrchr(path, '/') = 0;
+		if (!store_mkdir(path)) goto done;
+		*strchr(path, 0) = '/';
+		if (!store_write_file(path, data + offset, len)) goto done;
+		result->new_chunks++;
+		result->new_bytes += len;
+	}
+	result->chunks = m->count;
+
+	uint32_t revision = store_latest(st, key, kind);
+	if (revision) {
+		store_manifest_path(st, key, kind, revision, path, sizeof(path));
+		if (store_read_manifest(path, latest) && latest->size == m->size
+			&& !memcmp(latest->hash, m->hash, m->count * SHA256_SIZE)) {
+
+			result->revision = revision;
+			result->unchanged = true;
+			ok = true;
+			goto done;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/carts/%s", st->root, key);
+	if (!store_mkdir(path)) goto done;
+	result->revision = revision + 1;
+	store_manifest_path(st, key, kind, result->revision, path, sizeof(path));
+	ok = store_write_manifest(path, kind, m);
+
+done:
+	free(m);
+	return ok;
+}
+
+bool store_get(store_t *st, const char *key, const char *kind, uint8_t **data, uint32_t *size) {
+	char path[4200];
+	uint32_t revision = store_latest(st, key, kind);
+	store_manifest_t *m = malloc(sizeof(store_manifest_t));
+	bool ok = false;
+
+	*data = NULL;
+	if (m == NULL || !revision) goto done;
+	store_manifest_path(st, key, kind, revision, path, sizeof(path));
+	if (!store_read_manifest(path, m) || (*data = malloc(m->size)) == NULL) goto done;
+
+	for (uint16_t i = 0; i < m->count; i++) {
+		uint32_t offset = (uint32_t) i * STORE_CHUNK_SIZE;
+		uint32_t len = m->size - offset < STORE_CHUNK_SIZE ? m->size - offset : STORE_CHUNK_SIZE;
+		uint8_t hash[SHA256_SIZE];
+
+		store_chunk_path(st, m->hash[i], path, sizeof(path));
+		FILE *f = fopen(path, "rb");
+		if (f == NULL) goto done;
+		size_t read = fread(*data + offset, 1, len, f);
+		fclose(f);
+		sha256(*data + offset, len, hash);
+		if (read != len || memcmp(hash, m->hash[i], SHA256_SIZE)) goto done;
+	}
+	*size = m->size;
+	ok = true;
+
+done:
+	if (!ok) {
+		free(*data);
+		*data = NULL;
+	}
+	free(m);
+	return ok;
+}
+
+bool store_list(store_t *st) {
+	static const char *const kinds[] = {"rom", "sram", "eeprom"};
+	char path[4200];
+	store_manifest_t *m = malloc(sizeof(store_manifest_t));
+
+	snprintf(path, sizeof(path), "%s/carts", st->root);
+	DIR *dir = opendir(path);
+	if (dir == NULL || m == NULL) {
+		if (dir != NULL) closedir(dir);
+		free(m);
+		return false;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') continue;
+		for (size_t i = 0; i < sizeof(kinds) / sizeof(*kinds); i++) {
+			uint32_t revision = store_latest(st, entry->d_name, kinds[i]);
+			if (!revision) continue;
+			store_manifest_path(st, entry->d_name, kinds[i], revision, path, sizeof(path));
+			if (!store_read_manifest(path, m)) continue;
+			printf("%s %-6s revision %" PRIu32 ", %" PRIu32 " bytes\n",
+				entry->d_name, kinds[i], revision, m->size);
+		}
+	}
+	closedir(dir);
+	free(m);
+	return true;
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Content-addressed dump store.
+ *
+ * Dumps are cut into 64 KB chunks, one ROM bank each (the unit xmb_rom_read
+ * sends), and every chunk is kept once under its SHA-256:
+ *
+ *   ROOT/objects/ab/cdef...         chunk contents
+ *   ROOT/carts/KEY/rom-0001         manifests: size, header and chunk list
+ *   ROOT/carts/KEY/sram-0003
+ *
+ * KEY comes from the cartridge header, so finding earlier dumps of a
+ * cartridge is a directory lookup. A dump identical to the latest one of
+ * its kind adds nothing; a changed save adds only its changed chunks and a
+ * new manifest.
+ */
+
+#define STORE_CHUNK_SIZE 0x10000
+// "pp-ccgg-rr-ssss": publisher, color flag and game ID, revision, checksum
+#define STORE_KEY_LEN 16
+
+typedef struct {
+	char root[3072];
+} store_t;
+
+typedef struct {
+	uint32_t chunks;
+	uint32_t new_chunks;
+	uint32_t new_bytes;
+	// manifest revision the dump was stored as
+	uint32_t revision;
+	// the dump matched the latest revision; nothing was written
+	bool unchanged;
+} store_result_t;
+
+// create the store layout under root if needed
+bool store_open(store_t *st, const char *root);
+
+void store_key(const uint8_t header[16], char key[STORE_KEY_LEN]);
+
+// kind: "rom", "sram" or "eeprom"
+bool store_put(store_t *st, const uint8_t header[16], const char *kind,
+	const uint8_t *data, uint32_t size, store_result_t *result);
+
+/**
+ * Latest dump of a kind for a cartridge key. *data is allocated with
+ * malloc(). Returns false if there is none or a chunk is missing or damaged.
+ */
+bool store_get(store_t *st, const char *key, const char *kind, uint8_t **data, uint32_t *size);
+
+// print one line per stored cartridge and kind to stdout
+bool store_list(store_t *st);
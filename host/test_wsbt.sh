@@ -0,0 +1,152 @@
+#!/bin/bash
+# SPDX-License-Identifier: CC0-1.0
+#
+# End-to-end tests of wsbt against wsbt_sim, which runs the firmware's
+# transfer code over a pty.
+
+set -u
+HERE=$(cd "$(dirname "$0")" && pwd)
+WSBT="$HERE/wsbt -q"
+SIMULATOR="$HERE/wsbt_sim"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP"
+failed=0
+
+# start_device NAME ARGUMENTS...: start a simulator; its pty is in NAME.pty
+start_device() {
+	local name=$1
+	shift
+	# a stale pty path from the previous run must not be picked up
+	rm -f "$name.in" "$name.pty"
+	mkfifo "$name.in"
+	"$SIMULATOR" "$@" < "$name.in" > "$name.pty" &
+	echo $! > "$name.pid"
+	# holds the fifo open; closed after the job is started
+	exec {fd}> "$name.in"
+	eval "${name}_fd=$fd"
+	while [ ! -s "$name.pty" ]; do sleep 0.05; done
+}
+
+# start_job NAME: choose the menu entry on the device
+start_job() {
+	local fd_var="${1}_fd"
+	echo >&"${!fd_var}"
+	eval "exec ${!fd_var}>&-"
+}
+
+# run "simulator arguments" "wsbt arguments"
+run() {
+	start_device dev $1
+	$WSBT -p "$(head -1 dev.pty)" $2 > wsbt.log 2>&1 &
+	local wsbt_pid=$!
+	# the tool is listening; start the job on the device
+	sleep 0.3
+	start_job dev
+	wait $wsbt_pid
+	local result=$?
+	# a device left waiting for a failed tool never finishes
+	[ $result = 0 ] || kill "$(cat dev.pid)" 2>/dev/null
+	wait "$(cat dev.pid)" || result=1
+	return $result
+}
+
+# run_many COUNT "simulator arguments" "wsbt arguments": one tool, COUNT consoles
+run_many() {
+	local count=$1 ports=""
+	for i in $(seq $count); do
+		start_device "dev$i" $2
+		ports="$ports -p $(head -1 dev$i.pty)"
+	done
+	$WSBT $ports $3 > wsbt.log 2>&1 &
+	local wsbt_pid=$!
+	sleep 0.3
+	for i in $(seq $count); do
+		start_job "dev$i"
+	done
+	wait $wsbt_pid
+	local result=$?
+	for i in $(seq $count); do
+		[ $result = 0 ] || kill "$(cat dev$i.pid)" 2>/dev/null
+		wait "$(cat dev$i.pid)" || result=1
+	done
+	return $result
+}
+
+# all_match FILE...: every file equals rom.ws
+all_match() {
+	local f
+	for f in "$@"; do
+		cmp -s rom.ws "$f" || return 1
+	done
+}
+
+# key_of ROM: the cartridge key of a ROM image, as wsbt's store and database use
+key_of() {
+	od -An -tx1 -j $(($(stat -c %s "$1") - 16)) -N 16 "$1" \
+		| awk '{ printf "%s-%s%s-%s-%s%s\n", $7, $8, $9, $10, $16, $15 }' RS=
+}
+
+check() {
+	local name=$1
+	shift
+	if "$@"; then
+		echo "PASS $name"
+	else
+		echo "FAIL $name"
+		cat wsbt.log
+		failed=1
+	fi
+}
+
+$SIMULATOR mkrom 256 rom.ws
+head -c 32768 /dev/urandom > save.sav
+$SIMULATOR mkrom 128 small.ws
+dd if=/dev/zero bs=65536 count=4 2>/dev/null | tr '\0' '\377' > blank.ws
+dd if=/dev/zero bs=65536 count=4 of=zero.ws 2>/dev/null
+# a database that gets rom.ws smaller than its header says
+echo "$(key_of rom.ws)  128K  8K  0  test cartridge" > carts.db
+# rom.ws with one byte changed in its second bank; same header
+cp rom.ws redump.ws
+printf '\x5a' | dd of=redump.ws bs=1 seek=70000 conv=notrunc 2>/dev/null
+
+check "xmodem backup, automatic rate" \
+	eval 'run "backup rom.ws" "recv out.ws" && cmp -s rom.ws out.ws && grep -q "rate=2" wsbt.log'
+check "xmodem backup, 9600 bps" \
+	eval 'run "-r 9600 backup small.ws" "recv out.ws" && cmp -s small.ws out.ws'
+check "xmodem restore" \
+	eval 'run "-o restored.sav restore 32768" "send save.sav" && cmp -s save.sav restored.sav'
+check "remote ROM backup" \
+	eval 'run "remote rom.ws" "-r 192000 backup rom out.ws" && cmp -s rom.ws out.ws && grep -q "header checksum OK" wsbt.log'
+check "remote SRAM backup" \
+	eval 'run "remote rom.ws" "backup sram out.sav" && [ $(stat -c %s out.sav) = 32768 ]'
+check "remote flash" \
+	eval 'run "-o flashed.ws remote blank.ws" "-r 192000 flash rom.ws" && cmp -s rom.ws flashed.ws'
+check "remote flash over a programmed image with boot sectors" \
+	eval 'run "-o flashed.ws remote zero.ws" "flash rom.ws" && cmp -s rom.ws flashed.ws'
+check "remote flash: a failed write redoes its bank" \
+	eval 'run "-f 20 -o flashed.ws remote blank.ws" "flash rom.ws" && cmp -s rom.ws flashed.ws \
+		&& grep -q "1 bank(s) redone" wsbt.log'
+check "three consoles at once" \
+	eval 'run_many 3 "backup rom.ws" "recv out-%p.ws" && [ $(ls out-*.ws | wc -l) = 3 ] && all_match out-*.ws'
+check "database: menu backup asks for the ROM size" \
+	eval 'run "-i backup rom.ws" "-d carts.db recv out.ws" && tail -c 131072 rom.ws | cmp -s - out.ws'
+check "database: unknown cartridge keeps the header size" \
+	eval 'run "-i backup small.ws" "-d carts.db recv out.ws" && cmp -s small.ws out.ws \
+		&& grep -q "not in the database" wsbt.log'
+check "database: remote SRAM backup size" \
+	eval 'run "remote rom.ws" "-d carts.db backup sram out.sav" && [ $(stat -c %s out.sav) = 8192 ]'
+check "store: first dump" \
+	eval 'run "remote rom.ws" "-S store backup rom out.ws" && grep -q "revision 1, 4 of 4 chunks new" wsbt.log'
+check "store: re-dump reads only the changed bank" \
+	eval 'run "remote redump.ws" "-S store -r 192000 backup rom out.ws" && cmp -s redump.ws out.ws \
+		&& grep -q "3 bank(s) unchanged" wsbt.log && grep -q "revision 2, 1 of 4 chunks new" wsbt.log'
+check "store: menu backup of a stored ROM adds no chunks" \
+	eval 'run "backup rom.ws" "-S store recv out.ws" && grep -q "revision 3, 0 of 4 chunks new" wsbt.log'
+check "store: flashing stores nothing" \
+	eval 'run "-o flashed.ws remote blank.ws" "-S store flash rom.ws" && cmp -s rom.ws flashed.ws \
+		&& ! grep -q "stored:" wsbt.log && [ $(ls store/carts | wc -l) = 1 ]'
+check "store: get" \
+	eval '$WSBT -S store store get $($WSBT -S store store list | cut -d" " -f1) rom got.ws > wsbt.log && cmp -s rom.ws got.ws'
+
+exit $failed
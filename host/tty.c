@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <asm/termbits.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <wonderful.h>
+#include "tty.h"
+#include "xmodem.h"
+
+static const uint32_t tty_rates[XMODEM_RATE_COUNT] = {9600, 38400, 192000};
+
+uint32_t tty_rate_bps(uint8_t rate) {
+	return rate < XMODEM_RATE_COUNT ? tty_rates[rate] : 0;
+}
+
+// termios2 allows arbitrary rates such as 192000 bps
+static bool tty_configure(int fd, uint32_t bps) {
+	struct termios2 t;
+
+	if (ioctl(fd, TCGETS2, &t) < 0) return false;
+	t.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+	t.c_oflag &= ~OPOST;
+	t.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	t.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | (CBAUD << IBSHIFT));
+	t.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+	t.c_ispeed = bps;
+	t.c_ospeed = bps;
+	t.c_cc[VMIN] = 0;
+	t.c_cc[VTIME] = 0;
+	return ioctl(fd, TCSETS2, &t) >= 0;
+}
+
+int tty_open(const char *path) {
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) return -1;
+	if (!tty_configure(fd, tty_rates[XMODEM_RATE_9600])) {
+		close(fd);
+		return -1;
+	}
+	ioctl(fd, TCFLSH, TCIOFLUSH);
+	return fd;
+}
+
+bool tty_set_rate(int fd, uint8_t rate) {
+	if (rate >= XMODEM_RATE_COUNT) return false;
+	// TCSETS2 would change the rate under bytes still being sent
+	ioctl(fd, TCSBRK, 1);
+	return tty_configure(fd, tty_rates[rate]);
+}
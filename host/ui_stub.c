@@ -0,0 +1,34 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdint.h>
+#include <wonderful.h>
+#include "ui.h"
+
+// the drivers draw progress; nothing to show on the host
+
+void ui_clear_lines(uint8_t y_from, uint8_t y_to) {
+}
+
+void ui_puts(uint8_t x, uint8_t y, uint8_t color, const char __far* buf) {
+}
+
+void ui_printf(uint8_t x, uint8_t y, uint8_t color, const char __far* format, ...) {
+}
+
+void wait_for_keypress(void) {
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <ws.h>
+
+static uint8_t ports[256];
+
+static uint64_t ws_stub_ticks(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 12000 + ts.tv_nsec / 83334;
+}
+
+void outportb(uint16_t port, uint8_t value) {
+	ports[port & 0xFF] = value;
+}
+
+void outportw(uint16_t port, uint16_t value) {
+	ports[port & 0xFF] = value;
+	ports[(port + 1) & 0xFF] = value >> 8;
+}
+
+uint8_t inportb(uint16_t port) {
+	switch (port) {
+	case 0xB3:
+		// transmit buffer always empty
+		return 0x04;
+	default:
+		return ports[port & 0xFF];
+	}
+}
+
+uint16_t inportw(uint16_t port) {
+	switch (port) {
+	case 0xA8:
+		// HBlank timer at 12 kHz, counting down
+		return 0xFFFF - (uint16_t) ws_stub_ticks();
+	default:
+		return inportb(port) | (inportb(port + 1) << 8);
+	}
+}
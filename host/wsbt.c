@@ -0,0 +1,349 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Companion tool: talks to ws-backup-tool over a serial port.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wonderful.h>
+#include "cartdb.h"
+#include "flash.h"
+#include "remote.h"
+#include "scheduler.h"
+#include "session.h"
+#include "store.h"
+#include "tty.h"
+#include "xmodem.h"
+
+#define PORTS_MAX 64
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options] command [arguments]\n"
+		"\n"
+		"started from the device menu:\n"
+		"  recv FILE                    receive a backup\n"
+		"  send FILE                    send a file to restore or write to flash\n"
+		"\n"
+		"with the device in remote control mode:\n"
+		"  backup rom|sram|eeprom FILE  back up; the size comes from the header\n"
+		"  restore sram|eeprom FILE     restore a save\n"
+		"  flash FILE                   write a ROM image to the end of flash\n"
+		"\n"
+		"dump store (-S):\n"
+		"  store list                   list stored cartridges\n"
+		"  store get KEY rom|sram|eeprom FILE\n"
+		"                               write out the latest stored dump\n"
+		"\n"
+		"options:\n"
+		"  -p PORT     serial port (default: /dev/ttyUSB0); repeat to run the same\n"
+		"              job on several consoles at once, with %%p in FILE standing\n"
+		"              for the port name\n"
+		"  -r RATE     remote control line rate: 9600, 38400 or 192000 (default: 38400)\n"
+		"  -s BYTES    backup size, overriding the header\n"
+		"  -m MODE     flash mode: slow, wonderwitch, wsfm or mx29l (default: slow)\n"
+		"  -d FILE     cartridge database: exact sizes for known cartridges, for the\n"
+		"              device to ask for before a backup from its menu, and for\n"
+		"              remote backups\n"
+		"  -S DIR      dump store: received dumps are added to it, and remote ROM\n"
+		"              backups of a stored cartridge only read banks that changed\n"
+		"  -q          no progress output\n", name);
+}
+
+static uint32_t crc32(const uint8_t *data, uint32_t len) {
+	uint32_t crc = 0xFFFFFFFF;
+	while (len--) {
+		crc ^= *(data++);
+		for (uint8_t i = 0; i < 8; i++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static bool parse_space(const char *arg, uint8_t *space) {
+	if (!strcmp(arg, "rom")) *space = REMOTE_SPACE_ROM;
+	else if (!strcmp(arg, "sram")) *space = REMOTE_SPACE_SRAM;
+	else if (!strcmp(arg, "eeprom")) *space = REMOTE_SPACE_EEPROM;
+	else return false;
+	return true;
+}
+
+static const char *const space_names[] = {"rom", "sram", "eeprom"};
+
+static bool store_lookup(void *arg, const uint8_t header[16], uint8_t **data, uint32_t *size) {
+	char key[STORE_KEY_LEN];
+	store_key(header, key);
+	return store_get(arg, key, "rom", data, size);
+}
+
+static bool database_sizes(void *arg, const uint8_t header[16], session_sizes_t *sizes) {
+	const cartdb_entry_t *entry = cartdb_find(arg, header);
+	if (entry == NULL) return false;
+	sizes->rom = entry->rom;
+	sizes->sram = entry->sram;
+	sizes->eeprom = entry->eeprom;
+	return true;
+}
+
+static int store_command(store_t *st, int argc, char **argv) {
+	uint8_t space;
+	uint8_t *data;
+	uint32_t size;
+
+	if (argc == 1 && !strcmp(argv[0], "list")) {
+		return store_list(st) ? 0 : 1;
+	}
+	if (argc != 4 || strcmp(argv[0], "get") || !parse_space(argv[2], &space)) {
+		return -1;
+	}
+	if (!store_get(st, argv[1], space_names[space], &data, &size)) {
+		fprintf(stderr, "%s: no %s dump in the store\n", argv[1], argv[2]);
+		return 1;
+	}
+	FILE *f = fopen(argv[3], "wb");
+	bool ok = f != NULL && fwrite(data, 1, size, f) == size;
+	if (f != NULL && fclose(f)) ok = false;
+	free(data);
+	if (!ok) {
+		fprintf(stderr, "cannot write %s\n", argv[3]);
+		return 1;
+	}
+	printf("%s: %u bytes\n", argv[3], size);
+	return 0;
+}
+
+// add a received dump to the store, keyed by its cartridge header
+static void store_dump(store_t *st, const session_t *s) {
+	const uint8_t *header = s->header;
+	uint8_t space = s->config.space;
+	store_result_t result;
+	char key[STORE_KEY_LEN];
+
+	if (s->config.job == SESSION_XMODEM_RECV) {
+		// menu backups carry no header of their own; only whole ROMs can be keyed
+		if (session_rom_checksum(s->data, s->size) < 0) {
+			printf("not stored: no cartridge header\n");
+			return;
+		}
+		header = s->data + s->size - 16;
+		space = REMOTE_SPACE_ROM;
+	}
+	if (space >= sizeof(space_names) / sizeof(*space_names)) return;
+	store_key(header, key);
+	if (!store_put(st, header, space_names[space], s->data, s->size, &result)) {
+		fprintf(stderr, "cannot add the dump to the store\n");
+	} else if (result.unchanged) {
+		printf("stored: %s %s revision %u, unchanged\n", key, space_names[space], result.revision);
+	} else {
+		printf("stored: %s %s revision %u, %u of %u chunks new (%u KB)\n", key, space_names[space],
+			result.revision, result.new_chunks, result.chunks, result.new_bytes >> 10);
+	}
+}
+
+static bool parse_rate(const char *arg, uint8_t *rate) {
+	uint32_t bps = strtoul(arg, NULL, 0);
+	for (uint8_t i = 0; i < XMODEM_RATE_COUNT; i++) {
+		if (tty_rate_bps(i) == bps) {
+			*rate = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_mode(const char *arg, uint8_t *mode) {
+	static const char *const names[] = {"slow", "wonderwitch", "wsfm", "mx29l"};
+	for (uint8_t i = 0; i <= FLASH_MODE_FAST_MX29L; i++) {
+		if (!strcmp(arg, names[i])) {
+			*mode = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// %p in a path becomes the port name, so each console gets its own files
+static char *expand_path(const char *path, const char *port) {
+	const char *name = strrchr(port, '/') ? strrchr(port, '/') + 1 : port;
+	size_t len = strlen(path) + 1;
+	for (const char *p = path; (p = strstr(p, "%p")); p += 2) len += strlen(name);
+	char *result = malloc(len);
+	char *out = result;
+
+	for (const char *p = path; *p; p++) {
+		if (p[0] == '%' && p[1] == 'p') {
+			out += sprintf(out, "%s", name);
+			p++;
+		} else {
+			*(out++) = *p;
+		}
+	}
+	*out = 0;
+	return result;
+}
+
+int main(int argc, char **argv) {
+	session_config_t config = {.rate = XMODEM_RATE_38400};
+	const char *ports[PORTS_MAX];
+	size_t port_count = 0;
+	bool quiet = false;
+	const char *database = NULL;
+	cartdb_t db;
+	const char *store_root = NULL;
+	store_t st;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:r:s:m:d:S:qh")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (port_count == PORTS_MAX) {
+				fprintf(stderr, "too many ports\n");
+				return 1;
+			}
+			ports[port_count++] = optarg;
+			break;
+		case 'r':
+			if (!parse_rate(optarg, &config.rate)) {
+				fprintf(stderr, "unsupported rate: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 's': config.size = strtoul(optarg, NULL, 0); break;
+		case 'm':
+			if (!parse_mode(optarg, &config.flash_mode)) {
+				fprintf(stderr, "unknown flash mode: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'd': database = optarg; break;
+		case 'S': store_root = optarg; break;
+		case 'q': quiet = true; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	int args = argc - optind;
+	const char *cmd = args > 0 ? argv[optind] : "";
+	if (database != NULL) {
+		unsigned int line;
+		if (!cartdb_load(&db, database, &line)) {
+			if (line) fprintf(stderr, "%s:%u: malformed entry\n", database, line);
+			else perror(database);
+			return 1;
+		}
+		config.sizes = database_sizes;
+		config.sizes_arg = &db;
+	}
+	if (store_root != NULL && !store_open(&st, store_root)) {
+		perror(store_root);
+		return 1;
+	}
+	if (!strcmp(cmd, "store") && store_root != NULL) {
+		int result = store_command(&st, args - 1, argv + optind + 1);
+		if (result < 0) usage(argv[0]);
+		return result ? 1 : 0;
+	}
+	if (store_root != NULL) {
+		config.lookup = store_lookup;
+		config.lookup_arg = &st;
+	}
+
+	if (!strcmp(cmd, "recv") && args == 2) {
+		config.job = SESSION_XMODEM_RECV;
+	} else if (!strcmp(cmd, "send") && args == 2) {
+		config.job = SESSION_XMODEM_SEND;
+	} else if (!strcmp(cmd, "backup") && args == 3 && parse_space(argv[optind + 1], &config.space)) {
+		config.job = SESSION_REMOTE_BACKUP;
+	} else if (!strcmp(cmd, "restore") && args == 3 && parse_space(argv[optind + 1], &config.space)
+		&& config.space != REMOTE_SPACE_ROM) {
+		config.job = SESSION_REMOTE_RESTORE;
+	} else if (!strcmp(cmd, "flash") && args == 2) {
+		config.job = SESSION_REMOTE_FLASH;
+	} else {
+		usage(argv[0]);
+		return 1;
+	}
+	const char *path = argv[argc - 1];
+	bool receives = config.job == SESSION_XMODEM_RECV || config.job == SESSION_REMOTE_BACKUP;
+	if (port_count == 0) ports[port_count++] = "/dev/ttyUSB0";
+	if (port_count > 1 && receives && !strstr(path, "%p")) {
+		fprintf(stderr, "with several ports, FILE needs %%p for the port name\n");
+		return 1;
+	}
+
+	session_t *sessions[PORTS_MAX];
+	for (size_t i = 0; i < port_count; i++) {
+		session_t *s = malloc(sizeof(session_t));
+		config.path = expand_path(path, ports[i]);
+		sessions[i] = s;
+
+		int fd = tty_open(ports[i]);
+		if (fd < 0) {
+			perror(ports[i]);
+			return 1;
+		}
+		if (!session_init(s, &config, fd, session_now())) {
+			fprintf(stderr, "%s: %s\n", ports[i], s->error);
+			return 1;
+		}
+		session_tx_flush(s);
+	}
+
+	scheduler_run(sessions, ports, port_count, !quiet && isatty(STDERR_FILENO));
+
+	int result = 0;
+	for (size_t i = 0; i < port_count; i++) {
+		session_t *s = sessions[i];
+		const char *prefix = port_count > 1 ? ports[i] : NULL;
+		if (prefix) printf("%s:\n", prefix);
+		if (!session_finish(s)) {
+			fprintf(stderr, "%s%sfailed: %s\n", prefix ? prefix : "", prefix ? ": " : "", s->error);
+			result = 1;
+		} else {
+			printf("%s: %u bytes, CRC-32 %08X\n", s->config.path, s->size, crc32(s->data, s->size));
+			if (config.job == SESSION_XMODEM_RECV || config.space == REMOTE_SPACE_ROM) {
+				int sum = session_rom_checksum(s->data, s->size);
+				if (sum >= 0) printf("header checksum %s\n", sum ? "OK" : "MISMATCH");
+			}
+			// only received dumps are stored
+			if (store_root != NULL && receives) store_dump(&st, s);
+		}
+		if (database != NULL && s->identified) {
+			char key[STORE_KEY_LEN];
+			store_key(s->header, key);
+			printf("cartridge %s %s the database\n", key, cartdb_find(&db, s->header) ? "found in" : "not in");
+		}
+		printf("%u blocks, %u NAK, %u timeouts, %u rate changes",
+			s->blocks, s->naks, s->timeouts, s->rate_changes);
+		if (s->bank_retries) printf(", %u bank(s) redone after a failed write or checksum", s->bank_retries);
+		if (s->banks_reused) printf(", %u bank(s) unchanged from the store", s->banks_reused);
+		printf("\n");
+		if (s->stats[0]) printf("%s\n", s->stats);
+		close(s->fd);
+		free((char*) s->config.path);
+		session_free(s);
+		free(s);
+	}
+	if (database != NULL) cartdb_free(&db);
+	return result;
+}
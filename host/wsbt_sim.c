@@ -0,0 +1,350 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Device simulator for testing the companion tool: runs the firmware's
+ * XMODEM engine, transfer drivers and remote control framing over a pty,
+ * against a cartridge held in memory.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <wonderful.h>
+#include "crc16.h"
+#include "remote.h"
+#include "serial_pty.h"
+#include "timer.h"
+#include "transfer.h"
+#include "xmodem.h"
+
+static uint8_t *rom;
+static uint32_t rom_size;
+static uint8_t sram[0x80000];
+static uint8_t eeprom[2048];
+// the flash write, counted from 1, that fails; 0 for none
+static uint32_t flash_fault;
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-r rate] [-o FILE] [-i] [-f N] command [arguments]\n"
+		"  mkrom KB FILE     write a random ROM image with a valid header\n"
+		"  backup FILE       send FILE, as a backup from the menu does\n"
+		"  restore BYTES     receive BYTES, as a restore from the menu does\n"
+		"  remote ROM        serve remote control requests; ROM is also the flash\n"
+		"\n"
+		"  -r RATE   9600, 38400 or 192000 instead of automatic rate selection\n"
+		"  -o FILE   write the received data (restore) or the final flash (remote)\n"
+		"  -i        backup: first ask the host for the ROM size, as the backup\n"
+		"            menu does, and send only the last banks of FILE it names\n"
+		"  -f N      remote: the Nth flash write programs only half of its data\n"
+		"            and reports a failure, as a worn chip might\n"
+		"The pty path is printed on the first line of output. Like choosing the\n"
+		"menu entry on the device, a line on standard input starts the job.\n", name);
+}
+
+static bool load(const char *path, uint8_t **data, uint32_t *size) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return false;
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	*data = malloc(*size);
+	bool result = fread(*data, 1, *size, f) == *size;
+	fclose(f);
+	return result;
+}
+
+static bool save(const char *path, const uint8_t *data, uint32_t size) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) return false;
+	bool result = fwrite(data, 1, size, f) == size;
+	return !fclose(f) && result;
+}
+
+static int mkrom(uint32_t kbytes, const char *path) {
+	static const uint16_t banks[] = {2, 4, 8, 16, 32, 48, 64, 96, 128, 256, 512, 1024};
+	uint32_t size = kbytes << 10;
+	uint8_t *data = malloc(size);
+	uint8_t code = 0xFF;
+
+	for (uint8_t i = 0; i < sizeof(banks) / sizeof(*banks); i++) {
+		if (((uint32_t) banks[i] << 16) == size) code = i;
+	}
+	if (code == 0xFF) {
+		fprintf(stderr, "no ROM size code for %u KB\n", kbytes);
+		return 1;
+	}
+	srand(size);
+	for (uint32_t i = 0; i < size; i++) {
+		data[i] = rand();
+	}
+	uint8_t *header = data + size - 16;
+	header[0xA] = code;
+	// 32 KB SRAM
+	header[0xB] = 0x02;
+	uint16_t sum = 0;
+	for (uint32_t i = 0; i < size - 2; i++) {
+		sum += data[i];
+	}
+	header[0xE] = sum;
+	header[0xF] = sum >> 8;
+	return save(path, data, size) ? 0 : 1;
+}
+
+// --- remote control, against the in-memory cartridge ---
+
+// the flash has 64 KB sectors, except for the top-boot layout of its last
+// bank (32, 8, 8 and 16 KB), as on the MBM29DL400BC
+static uint32_t sim_sector_size(uint32_t pos, uint32_t *base) {
+	uint32_t top = rom_size - 0x10000;
+	if (pos < top) {
+		*base = pos & ~0xFFFF;
+		return 0x10000;
+	}
+	static const uint16_t boot[] = {0x8000, 0x2000, 0x2000, 0x4000};
+	*base = top;
+	for (uint8_t i = 0;; i++) {
+		if (pos < *base + boot[i]) return boot[i];
+		*base += boot[i];
+	}
+}
+
+static bool sim_blank(const uint8_t *data, uint32_t len) {
+	while (len--) {
+		if (*(data++) != 0xFF) return false;
+	}
+	return true;
+}
+
+static uint8_t *sim_map(uint8_t space, uint32_t address, uint32_t *avail) {
+	uint16_t bank = address >> 16;
+	uint16_t offset = address;
+
+	switch (space) {
+	case REMOTE_SPACE_ROM:
+	case REMOTE_SPACE_FLASH: {
+		// the image repeats below the end of the bank space
+		uint32_t pos = ((uint32_t) (uint16_t) (bank - (0x10000 - (rom_size >> 16))) << 16) % rom_size + offset;
+		*avail = rom_size - pos;
+		return rom + pos;
+	}
+	case REMOTE_SPACE_SRAM: {
+		uint32_t pos = (((uint32_t) bank << 16) + offset) % sizeof(sram);
+		*avail = sizeof(sram) - pos;
+		return sram + pos;
+	}
+	case REMOTE_SPACE_EEPROM:
+		*avail = address < sizeof(eeprom) ? sizeof(eeprom) - address : 0;
+		return eeprom + (address < sizeof(eeprom) ? address : 0);
+	}
+	*avail = 0;
+	return NULL;
+}
+
+static bool sim_execute(uint8_t cmd, uint16_t len) {
+	const uint8_t *p = remote_payload;
+	uint32_t avail;
+	uint8_t *data;
+
+	switch (cmd) {
+	case REMOTE_CMD_IDENTIFY: {
+		uint8_t result[17];
+		result[0] = REMOTE_VERSION;
+		memcpy(result + 1, rom + rom_size - 16, 16);
+		remote_reply(cmd, REMOTE_OK, result, sizeof(result));
+		return true;
+	}
+	case REMOTE_CMD_READ: {
+		uint16_t n = remote_get16(p + 5);
+		data = sim_map(p[0], remote_get32(p + 1), &avail);
+		if (len != 7 || data == NULL || n > avail || n > XMODEM_BLOCK_SIZE_MAX) break;
+		remote_reply(cmd, REMOTE_OK, data, n);
+		return true;
+	}
+	case REMOTE_CMD_WRITE: {
+		data = sim_map(p[0], remote_get32(p + 1), &avail);
+		if (len < 5 || data == NULL || p[0] == REMOTE_SPACE_ROM || (uint32_t) (len - 5) > avail) break;
+		bool fail = p[0] == REMOTE_SPACE_FLASH && flash_fault && !--flash_fault;
+		uint16_t n = fail ? (len - 5) / 2 : len - 5;
+		for (uint16_t i = 0; i < n; i++) {
+			// flash programming only clears bits; the chip reports setting one
+			if (p[0] == REMOTE_SPACE_FLASH && (p[i + 5] & ~data[i])) fail = true;
+			data[i] = p[0] == REMOTE_SPACE_FLASH ? (data[i] & p[i + 5]) : p[i + 5];
+		}
+		remote_reply(cmd, fail ? REMOTE_ERROR_FAILED : REMOTE_OK, NULL, 0);
+		return true;
+	}
+	case REMOTE_CMD_ERASE:
+		data = sim_map(REMOTE_SPACE_FLASH, remote_get32(p) & 0xFFFF0000, &avail);
+		if (len != 4) break;
+		// as the device does: each 8 KB region not yet blank erases its sector
+		for (uint32_t region = 0; region < 0x10000 && region < avail; region += 0x2000) {
+			if (sim_blank(data + region, 0x2000)) continue;
+			uint32_t base;
+			uint32_t size = sim_sector_size(data + region - rom, &base);
+			memset(rom + base, 0xFF, size);
+		}
+		remote_reply(cmd, REMOTE_OK, NULL, 0);
+		return true;
+	case REMOTE_CMD_CRC: {
+		uint32_t n = remote_get32(p + 5);
+		data = sim_map(p[0], remote_get32(p + 1), &avail);
+		if (len != 9 || data == NULL || n > avail) break;
+		uint16_t crc = 0;
+		// crc16() takes 16-bit lengths
+		for (uint32_t i = 0; i < n; i += 0x8000) {
+			crc = crc16(data + i, n - i < 0x8000 ? n - i : 0x8000, crc);
+		}
+		uint8_t result[2] = {crc >> 8, crc};
+		remote_reply(cmd, REMOTE_OK, result, 2);
+		return true;
+	}
+	case REMOTE_CMD_CONFIG:
+		remote_reply(cmd, len == 2 ? REMOTE_OK : REMOTE_ERROR_ARGUMENT, NULL, 0);
+		return true;
+	case REMOTE_CMD_BAUD:
+		if (len != 1 || p[0] >= XMODEM_RATE_COUNT) break;
+		remote_reply(cmd, REMOTE_OK, NULL, 0);
+		xmodem_set_rate(p[0]);
+		return true;
+	case REMOTE_CMD_EXIT:
+		remote_reply(cmd, REMOTE_OK, NULL, 0);
+		return false;
+	default:
+		remote_reply(cmd, REMOTE_ERROR_COMMAND, NULL, 0);
+		return true;
+	}
+	remote_reply(cmd, REMOTE_ERROR_ARGUMENT, NULL, 0);
+	return true;
+}
+
+// --- menu transfers ---
+
+static uint8_t *transfer_data;
+
+static const uint8_t *sim_read(uint32_t offset, uint16_t len) {
+	return transfer_data + offset;
+}
+
+static void sim_write(uint32_t offset, const uint8_t *data, uint16_t len) {
+	memcpy(transfer_data + offset, data, len);
+}
+
+static int open_pty(void) {
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) || unlockpt(fd)) return -1;
+
+	// hold the other end open and raw, so nothing is echoed before the tool configures it
+	struct termios t;
+	int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &t)) return -1;
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+
+	printf("%s\n", ptsname(fd));
+	fflush(stdout);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+int main(int argc, char **argv) {
+	const char *output = NULL;
+	bool identify = false;
+	int opt;
+
+	xm_baudrate = XMODEM_RATE_AUTO;
+	while ((opt = getopt(argc, argv, "r:o:if:h")) != -1) {
+		switch (opt) {
+		case 'r': {
+			uint32_t bps = strtoul(optarg, NULL, 0);
+			xm_baudrate = bps == 9600 ? XMODEM_RATE_9600 : (bps == 38400 ? XMODEM_RATE_38400 : XMODEM_RATE_192000);
+		} break;
+		case 'o': output = optarg; break;
+		case 'i': identify = true; break;
+		case 'f': flash_fault = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	int args = argc - optind;
+	const char *cmd = args > 0 ? argv[optind] : "";
+	if (!strcmp(cmd, "mkrom") && args == 3) {
+		return mkrom(strtoul(argv[optind + 1], NULL, 0), argv[optind + 2]);
+	}
+
+	uint32_t size = 0;
+	if (!strcmp(cmd, "backup") && args == 2) {
+		if (!load(argv[optind + 1], &transfer_data, &size)) {
+			perror(argv[optind + 1]);
+			return 1;
+		}
+	} else if (!strcmp(cmd, "restore") && args == 2) {
+		size = strtoul(argv[optind + 1], NULL, 0);
+		transfer_data = calloc(1, size);
+	} else if (!strcmp(cmd, "remote") && args == 2) {
+		if (!load(argv[optind + 1], &rom, &rom_size) || rom_size < 0x10000 || (rom_size & 0xFFFF)) {
+			fprintf(stderr, "%s: not a ROM image\n", argv[optind + 1]);
+			return 1;
+		}
+		memset(sram, 0xFF, sizeof(sram));
+		memset(eeprom, 0xFF, sizeof(eeprom));
+	} else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if ((serial_pty_fd = open_pty()) < 0) {
+		perror("pty");
+		return 1;
+	}
+	timer_init();
+	char line[16];
+	if (fgets(line, sizeof(line), stdin) == NULL) return 1;
+
+	bool ok = true;
+	if (!strcmp(cmd, "backup")) {
+		xmodem_cart_sizes_t sizes;
+		// the header is at the end of the image; the dump covers the banks below it
+		if (identify && size >= 16 && xmodem_query_sizes(transfer_data + size - 16, &sizes)
+			&& ((uint32_t) sizes.rom_banks << 16) < size) {
+			transfer_data += size - ((uint32_t) sizes.rom_banks << 16);
+			size = (uint32_t) sizes.rom_banks << 16;
+		}
+		xmodem_run_send(sim_read, size, 10);
+	} else if (!strcmp(cmd, "restore")) {
+		xmodem_run_recv(sim_write, size, 10, false);
+		ok = !output || save(output, transfer_data, size);
+	} else {
+		xmodem_open_default();
+		while (true) {
+			uint16_t len;
+			uint8_t cmd = remote_recv(&len, TIMER_HZ / 8);
+			if (cmd != REMOTE_CMD_NONE && !sim_execute(cmd, len)) break;
+		}
+		xmodem_close();
+		ok = !output || save(output, rom, rom_size);
+	}
+	// let the last bytes reach the other end
+	usleep(100000);
+	return ok ? 0 : 1;
+}
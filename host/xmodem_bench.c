@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * Runs the firmware's XMODEM engine and transfer drivers against a host
+ * peer over a simulated serial line, and reports how efficiently the line
+ * was used.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "link.h"
+#include "peer.h"
+#include "timer.h"
+#include "transfer.h"
+#include "xmodem.h"
+
+static uint8_t *bench_image;
+static uint8_t *bench_result;
+
+static const uint8_t *bench_read(uint32_t offset, uint16_t len) {
+	return bench_image + offset;
+}
+
+static void bench_write(uint32_t offset, const uint8_t *data, uint16_t len) {
+	memcpy(bench_result + offset, data, len);
+}
+
+static const uint32_t bench_rates[XMODEM_RATE_COUNT] = {9600, 38400, 192000};
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -d send|recv   direction, as seen from the device (default: send)\n"
+		"  -r rate        9600, 38400 or 192000 bps (default: 192000)\n"
+		"  -s size        transfer size in bytes (default: 65536)\n"
+		"  -l ms          one-way line latency (default: 0)\n"
+		"  -e rate        bit error rate, e.g. 1e-5 (default: 0)\n"
+		"  -S seed        random seed for data and bit errors (default: 1)\n"
+		"  -1             host sends 128-byte blocks only\n", name);
+}
+
+int main(int argc, char **argv) {
+	link_config_t config = {.baud = 192000, .seed = 1};
+	peer_session_t peer = {.size = 65536, .use_1k = true};
+	bool device_send = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:r:s:l:e:S:1h")) != -1) {
+		switch (opt) {
+		case 'd': device_send = strcmp(optarg, "recv"); break;
+		case 'r': config.baud = strtoul(optarg, NULL, 0); break;
+		case 's': peer.size = strtoul(optarg, NULL, 0); break;
+		case 'l': config.latency_ms = strtod(optarg, NULL); break;
+		case 'e': config.bit_error_rate = strtod(optarg, NULL); break;
+		case 'S': config.seed = strtoul(optarg, NULL, 0); break;
+		case '1': peer.use_1k = false; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	xm_baudrate = XMODEM_RATE_COUNT;
+	for (uint8_t i = 0; i < XMODEM_RATE_COUNT; i++) {
+		if (bench_rates[i] == config.baud) xm_baudrate = i;
+	}
+	// the device may change rates only under XMODEM_RATE_AUTO, which the link does not model
+	if (xm_baudrate == XMODEM_RATE_COUNT || peer.size == 0 || (peer.size & (XMODEM_BLOCK_SIZE - 1))) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_image = malloc(peer.size);
+	bench_result = calloc(1, peer.size);
+	peer.data = device_send ? bench_result : bench_image;
+	srand(config.seed);
+	for (uint32_t i = 0; i < peer.size; i++) {
+		bench_image[i] = rand();
+	}
+
+	link_init(&config);
+	timer_init();
+
+	pthread_t thread;
+	double start = link_now_ms();
+	pthread_create(&thread, NULL, device_send ? peer_receive : peer_send, &peer);
+	if (device_send) {
+		xmodem_run_send(bench_read, peer.size, 10);
+	} else {
+		xmodem_run_recv(bench_write, peer.size, 10, false);
+	}
+	pthread_join(thread, NULL);
+	double elapsed = link_now_ms() - start;
+
+	link_counters_t counters;
+	link_counters(&counters);
+	uint64_t line_bytes = counters.bytes[LINK_TO_HOST] + counters.bytes[LINK_TO_DEVICE];
+	bool match = peer.ok && !memcmp(bench_image, bench_result, peer.size);
+
+	printf("direction    %s, %u bps, %u bytes\n", device_send ? "device to host" : "host to device",
+		config.baud, peer.size);
+	printf("link         %.1f ms latency, bit error rate %g\n", config.latency_ms, config.bit_error_rate);
+	printf("result       %s\n", match ? "OK" : "FAILED");
+	printf("elapsed      %.0f ms (line busy %.0f ms)\n", elapsed, line_bytes * 10000.0 / config.baud);
+	printf("throughput   %.0f B/s (%.1f%% of line rate)\n",
+		peer.size * 1000.0 / elapsed, peer.size * 1000.0 / elapsed * 1000.0 / config.baud);
+	printf("efficiency   %.1f%% (payload / line bytes)\n", line_bytes ? peer.size * 100.0 / line_bytes : 0);
+	printf("line bytes   %llu to host, %llu to device, %llu + %llu corrupted\n",
+		(unsigned long long) counters.bytes[LINK_TO_HOST], (unsigned long long) counters.bytes[LINK_TO_DEVICE],
+		(unsigned long long) counters.corrupted[LINK_TO_HOST], (unsigned long long) counters.corrupted[LINK_TO_DEVICE]);
+	printf("round trips  %llu\n", (unsigned long long) (counters.turnarounds / 2));
+	printf("device       blocks=%u naks=%u retries=%u timeouts=%u wait=%u%% io=%u%%\n",
+		xmodem_stats.blocks, xmodem_stats.naks, xmodem_stats.retries, xmodem_stats.timeouts,
+		xmodem_stats.ticks ? (unsigned) (xmodem_stats.wait_ticks * 100 / xmodem_stats.ticks) : 0,
+		xmodem_stats.ticks ? (unsigned) (xmodem_stats.io_ticks * 100 / xmodem_stats.ticks) : 0);
+	printf("host         naks=%u timeouts=%u\n", peer.naks, peer.timeouts);
+	if (peer.stats[0]) printf("%s\n", peer.stats);
+	return match ? 0 : 1;
+}
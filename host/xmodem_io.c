@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+/**
+ * C reference versions of the polled loops in src/xmodem_io.s.
+ */
+
+#include <stdint.h>
+#include <wonderful.h>
+#include <ws.h>
+#include "crc16.h"
+#include "timer.h"
+#include "xmodem.h"
+#include "xmodem_io.h"
+
+// roughly the 65536 status polls the assembly waits per byte
+#define XMODEM_IO_TIMEOUT_TICKS (TIMER_HZ / 4)
+
+uint8_t xmodem_io_write_sum(const uint8_t __far* data, uint16_t len) {
+	uint8_t sum = 0;
+	while (len--) {
+		ws_serial_putc(*data);
+		sum += *(data++);
+	}
+	return sum;
+}
+
+uint16_t xmodem_io_write_crc(const uint8_t __far* data, uint16_t len) {
+	uint16_t crc = 0;
+	while (len--) {
+		ws_serial_putc(*data);
+		crc = crc16_update(crc, *(data++));
+	}
+	return crc;
+}
+
+uint16_t xmodem_io_read_sum(uint8_t __far* data, uint16_t len, uint16_t *result) {
+	uint8_t sum = 0;
+	uint16_t i;
+	for (i = 0; i < len; i++) {
+		int16_t v = xmodem_getc_timeout(XMODEM_IO_TIMEOUT_TICKS);
+		if (v < 0) break;
+		data[i] = v;
+		sum += v;
+	}
+	*result = sum;
+	return i;
+}
+
+uint16_t xmodem_io_read_crc(uint8_t __far* data, uint16_t len, uint16_t *result) {
+	uint16_t crc = 0;
+	uint16_t i;
+	for (i = 0; i < len; i++) {
+		int16_t v = xmodem_getc_timeout(XMODEM_IO_TIMEOUT_TICKS);
+		if (v < 0) break;
+		data[i] = v;
+		crc = crc16_update(crc, v);
+	}
+	*result = crc;
+	return i;
+}
@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <ws.h>
+#include "bank.h"
+
+uint16_t bank_current[3];
+uint8_t bank_valid;
+
+void bank_write(uint8_t window, uint16_t bank) {
+	outportw(IO_BANK_2003_RAM + (window << 1), bank);
+	outportb(IO_BANK_RAM + window, bank);
+	bank_current[window] = bank;
+	bank_valid |= 1 << window;
+}
+
+void bank_reset(void) {
+	bank_valid = 0;
+	bank_write(BANK_ROM0, 0xFFFF);
+	bank_write(BANK_RAM, 0xFFFF);
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Cartridge bank registers, cached. Each window has an 8-bit register and a
+ * 16-bit one on the 2003 mapper; both are written, 16-bit first, and only
+ * when the bank actually changes. The 2001 mapper ignores the 16-bit ports.
+ *
+ * The registers live in the cartridge's mapper, so a swapped cartridge
+ * does not match the cache; menus start with bank_reset().
+ */
+#define BANK_RAM  0
+#define BANK_ROM0 1
+#define BANK_ROM1 2
+
+extern uint16_t bank_current[3];
+extern uint8_t bank_valid;
+
+void bank_write(uint8_t window, uint16_t bank);
+
+static inline void bank_set(uint8_t window, uint16_t bank) {
+	if (!(bank_valid & (1 << window)) || bank_current[window] != bank) {
+		bank_write(window, bank);
+	}
+}
+
+// forget the cache and map the last banks, where the header is, into ROM0 and RAM
+void bank_reset(void);
@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <wonderful.h>
+
+// CRC-16/XMODEM: polynomial 0x1021, initial value 0
+extern const uint16_t crc16_nibble_table[16];
+
+static inline uint16_t crc16_update(uint16_t crc, uint8_t v) {
+	crc = (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (v >> 4)];
+	return (crc << 4) ^ crc16_nibble_table[(crc >> 12) ^ (v & 0x0F)];
+}
+
+uint16_t crc16(const uint8_t __far* data, uint16_t len, uint16_t crc);
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ws.h>
+#include "eeprom.h"
+#include "timer.h"
+
+#define EEP_PORT_COMMAND 0xC6
+#define EEP_PORT_CONTROL 0xC8
+
+#define EEP_CONTROL_SHORT 0x40 /* EWEN/EWDS/ERAL/WRAL */
+#define EEP_STATUS_READY 0x02
+
+// opcode 00, top two address bits
+#define EEP_OP_ERAL 0x2
+
+static bool eeprom_wait_ready(void) {
+	uint32_t start = timer_ticks();
+	while (!(inportb(EEP_PORT_CONTROL) & EEP_STATUS_READY)) {
+		// ERAL takes at most ~15 ms
+		if ((timer_ticks() - start) >= (TIMER_HZ / 20)) return false;
+	}
+	return true;
+}
+
+static bool eeprom_short_command(uint8_t address_bits, uint8_t op) {
+	if (!eeprom_wait_ready()) return false;
+	// start bit, opcode 00, then op in the top two address bits
+	outportw(EEP_PORT_COMMAND, (1 << (address_bits + 2)) | ((uint16_t) op << (address_bits - 2)));
+	outportb(EEP_PORT_CONTROL, EEP_CONTROL_SHORT);
+	return eeprom_wait_ready();
+}
+
+bool eeprom_erase_all(uint8_t address_bits) {
+	ws_eeprom_handle_t h = ws_eeprom_handle_cartridge(address_bits);
+
+	ws_eeprom_write_unlock(h);
+	bool result = eeprom_short_command(address_bits, EEP_OP_ERAL);
+	ws_eeprom_write_lock(h);
+	if (!result) return false;
+
+	// some devices ignore ERAL without reporting it
+	for (uint16_t p = 0; p < (2 << address_bits); p += 2) {
+		if (ws_eeprom_read_word(h, p) != 0xFFFF) return false;
+	}
+	return true;
+}
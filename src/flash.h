@@ -25,5 +25,7 @@
 #define FLASH_MODE_FAST_FLASHMASTA 0x02
 #define FLASH_MODE_FAST_MX29L 0x03
 
+// Both return false if the chip reported a failure (DQ5) or did not finish
+// in time; the chip is then reset to read mode. The data is not verified.
 bool flash_write(const void *data, uint16_t offset, uint16_t len, uint16_t mode);
 bool flash_erase(uint16_t offset, uint16_t mode);
@@ -34,15 +34,35 @@ _driver_reset_flash:
 	pop ds
 	ret
 
+	// Wait for a byte program: DQ6 toggles until it is done. Returns with
+	// carry set if the chip reported a failure (DQ5 while still toggling)
+	// or never finished; the caller then resets it. Clobbers AL and DX.
 	.align 2
 _flash_write_busyloop:
+	xor dx, dx
+_flash_write_busyloop_loop:
 	nop
 	nop
 	mov al, byte ptr es:[di]
 	nop
 	nop
-	cmp al, byte ptr es:[di]
-	jne _flash_write_busyloop
+	xor al, byte ptr es:[di]
+	jz _flash_write_busyloop_done
+	test byte ptr es:[di], 0x20
+	jnz _flash_write_busyloop_dq5
+	dec dx
+	jnz _flash_write_busyloop_loop
+	stc
+	ret
+_flash_write_busyloop_dq5:
+	// DQ5 may rise just as the program completes; look once more
+	mov al, byte ptr es:[di]
+	xor al, byte ptr es:[di]
+	jz _flash_write_busyloop_done
+	stc
+	ret
+_flash_write_busyloop_done:
+	clc
 	ret
 
 	.align 2
@@ -63,7 +83,9 @@ flash_write:
 	mov es, bx
 	mov bx, 0xAAAA
 
+	// AH: result
 	mov ax, [bp + IA16_CALL_STACK_OFFSET(10)]
+	mov ah, 1
 	cmp al, 3
 	je flash_write_fast_mx29l
 	cmp al, 2
@@ -83,6 +105,7 @@ flash_write_slow_loop:
 	nop
 	movsb
 	call _flash_write_busyloop
+	jc flash_write_slow_fail
 	loop flash_write_slow_loop // 5 cycles
 
 	push es
@@ -90,6 +113,13 @@ flash_write_slow_loop:
 
 	jmp flash_write_end
 
+flash_write_slow_fail:
+	mov ah, 0
+	mov byte ptr es:[bx], 0xF0
+	push es
+	pop ds
+	jmp flash_write_end
+
 	// === MX29L ===
 
 flash_write_fast_mx29l:
@@ -109,11 +139,17 @@ flash_write_fast_mx29l_loop:
 
 	pop di
 
+	// the other status bits are not relied upon; callers verify the data
+	xor dx, dx
 flash_write_fast_mx29l_wait:
 	mov al, byte ptr es:[di]
 	test al, 0x80
-	jz flash_write_fast_mx29l_wait
+	jnz flash_write_fast_mx29l_ready
+	dec dx
+	jnz flash_write_fast_mx29l_wait
+	mov ah, 0
 
+flash_write_fast_mx29l_ready:
 	push es
 	pop ds
 
@@ -138,8 +174,16 @@ flash_write_fast_wonderwitch_loop:
 	mov byte ptr es:[bx], 0xA0
 	movsb
 	call _flash_write_busyloop
+	jc flash_write_fast_wonderwitch_fail
 	loop flash_write_fast_wonderwitch_loop // 5 cycles
+	jmp flash_write_fast_wonderwitch_stop
 
+flash_write_fast_wonderwitch_fail:
+	mov ah, 0
+	// back to bypass mode from the failed program, then out of it
+	mov byte ptr es:[bx], 0xF0
+
+flash_write_fast_wonderwitch_stop:
 	push es
 	pop ds
 
@@ -164,8 +208,16 @@ flash_write_fast_flashmasta_loop:
 	mov byte ptr es:[bx], 0xA0
 	movsb
 	call _flash_write_busyloop
+	jc flash_write_fast_flashmasta_fail
 	loop flash_write_fast_flashmasta_loop // 5 cycles
+	jmp flash_write_fast_flashmasta_stop
+
+flash_write_fast_flashmasta_fail:
+	mov ah, 0
+	// back to bypass mode from the failed program, then out of it
+	mov byte ptr es:[bx], 0xF0
 
+flash_write_fast_flashmasta_stop:
 	push es
 	pop ds
 
@@ -179,6 +231,9 @@ flash_write_fast_flashmasta_loop:
 	mov byte ptr [0xAAAA], 0xF0
 
 flash_write_end:
+	mov al, ah
+	xor ah, ah
+
 	pop	bp
 	pop	es
 	pop	ds
@@ -206,6 +261,9 @@ flash_erase:
 	mov bx, ax
 	mov byte ptr [bx], 0x30
 
+	// 64 x 65536 polls, well past the longest sector erase
+	mov si, 64
+	xor cx, cx
 	.balign 2, 0x90
 flash_erase_busyloop:
 	nop
@@ -215,9 +273,27 @@ flash_erase_busyloop:
 	nop
 	nop
 	nop
-	cmp al, byte ptr [bx] // DQ2 and/or DQ6 toggles if status register
-	jne flash_erase_busyloop
+	xor al, byte ptr [bx] // DQ2 and/or DQ6 toggles if status register
+	jz flash_erase_done
+	test byte ptr [bx], 0x20 // DQ5: exceeded timing limits
+	jnz flash_erase_dq5
+	loop flash_erase_busyloop
+	dec si
+	jnz flash_erase_busyloop
+	jmp flash_erase_fail
+
+flash_erase_dq5:
+	mov al, byte ptr [bx]
+	xor al, byte ptr [bx]
+	jz flash_erase_done
+flash_erase_fail:
+	mov byte ptr [bx], 0xF0
+	xor ax, ax
+	jmp flash_erase_end
 
+flash_erase_done:
+	mov ax, 1
+flash_erase_end:
 	pop si
 	pop ds
 
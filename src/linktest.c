@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ws.h>
+#include "linktest.h"
+#include "timer.h"
+#include "xmodem.h"
+
+#define LINKTEST_BLOCKS 32
+#define LINKTEST_MAX_RETRIES 3
+
+// SOH, index, ~index, data, checksum - same shape as an XMODEM block
+static uint8_t linktest_frame[XMODEM_BLOCK_SIZE + 4];
+
+static void linktest_build_frame(uint8_t idx) {
+	uint8_t checksum = 0;
+	linktest_frame[0] = 0x01;
+	linktest_frame[1] = idx;
+	linktest_frame[2] = idx ^ 0xFF;
+	// every byte value appears once every two blocks
+	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
+		uint8_t v = (idx << 7) + i;
+		linktest_frame[i + 3] = v;
+		checksum += v;
+	}
+	linktest_frame[XMODEM_BLOCK_SIZE + 3] = checksum;
+}
+
+static void linktest_rate(linktest_result_t *result) {
+	uint32_t payload = 0;
+
+	memset(result, 0, sizeof(linktest_result_t));
+	xmodem_flush();
+
+	uint32_t start = timer_ticks();
+	for (uint8_t ib = 0; ib < LINKTEST_BLOCKS; ib++) {
+		linktest_build_frame(ib);
+		for (uint8_t attempt = 0; attempt <= LINKTEST_MAX_RETRIES; attempt++) {
+			if (attempt) result->retries++;
+			uint8_t r = xmodem_echo(linktest_frame, sizeof(linktest_frame));
+			if (r == XMODEM_OK) {
+				payload += XMODEM_BLOCK_SIZE;
+				break;
+			} else if (r == XMODEM_TIMEOUT) {
+				result->timeouts++;
+			} else {
+				result->checksum_errors++;
+			}
+			xmodem_flush();
+		}
+	}
+	uint32_t ticks = timer_ticks() - start;
+
+	result->bytes_per_second = ticks ? (payload * TIMER_HZ / ticks) : 0;
+}
+
+// switches only once the host has echoed the request; a lost request or
+// echo is asked again at the old rate
+static bool linktest_request_rate(uint8_t from, uint8_t rate) {
+	for (uint8_t attempt = 0; attempt <= LINKTEST_MAX_RETRIES; attempt++) {
+		if (xmodem_request_rate(rate)) return true;
+		xmodem_set_rate(from);
+		xmodem_flush();
+	}
+	return false;
+}
+
+uint8_t linktest_run(linktest_result_t results[XMODEM_RATE_COUNT]) {
+	uint8_t best = XMODEM_RATE_9600;
+	uint16_t best_bps = 0;
+	uint8_t rate = XMODEM_RATE_9600;
+
+	memset(results, 0, sizeof(linktest_result_t) * XMODEM_RATE_COUNT);
+	xmodem_open(XMODEM_RATE_9600);
+	cpu_irq_disable();
+	for (uint8_t next = XMODEM_RATE_9600; next < XMODEM_RATE_COUNT; next++) {
+		if (next != rate) {
+			if (!linktest_request_rate(rate, next)) {
+				// nothing faster is reachable either
+				for (; next < XMODEM_RATE_COUNT; next++) results[next].unreachable = true;
+				break;
+			}
+			rate = next;
+		}
+		linktest_rate(results + rate);
+		if (!results[rate].checksum_errors && !results[rate].timeouts
+			&& results[rate].bytes_per_second > best_bps) {
+			best = rate;
+			best_bps = results[rate].bytes_per_second;
+		}
+	}
+
+	// back down one rate at a time, as the fastest rate tried may be the one
+	// that just failed; the final request then goes out at 9600 bps
+	while (rate > XMODEM_RATE_9600 && linktest_request_rate(rate, rate - 1)) {
+		rate--;
+	}
+	if (rate == XMODEM_RATE_9600 && best != XMODEM_RATE_9600
+		&& linktest_request_rate(XMODEM_RATE_9600, best)) {
+		rate = best;
+	}
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	xmodem_close();
+
+	return rate;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "xmodem.h"
+
+typedef struct {
+	uint16_t bytes_per_second;
+	uint8_t retries;
+	uint8_t checksum_errors;
+	uint8_t timeouts;
+	// the host did not echo the switch to this rate; it was not tested
+	bool unreachable;
+} linktest_result_t;
+
+/**
+ * Run an echo exchange with the host at every supported rate, starting at
+ * 9600 bps. The host (or a loopback plug) is expected to echo every byte,
+ * including the rate switch requests.
+ *
+ * Returns the rate both ends are left at: the fastest which completed
+ * without errors, or a slower one if the host did not echo the switch.
+ */
+uint8_t linktest_run(linktest_result_t results[XMODEM_RATE_COUNT]);
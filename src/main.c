@@ -20,15 +20,24 @@
 #include <stdio.h>
 #include <wonderful.h>
 #include <ws.h>
+#include "bank.h"
+#include "crc16.h"
+#include "eeprom.h"
 #include "flash.h"
 #include "font_default.h"
 #include "input.h"
+#include "linktest.h"
+#include "memory.h"
+#include "patch.h"
+#include "profile.h"
+#include "remote.h"
+#include "timer.h"
+#include "transfer.h"
 #include "ui.h"
 #include "util.h"
 #include "xmodem.h"
 
 volatile uint16_t vbl_ticks;
-volatile uint8_t xm_baudrate;
 
 extern void vblank_int_handler(void);
 
@@ -36,156 +45,6 @@ static const char msg_are_you_sure[] = "Are you sure?";
 static const char msg_yes[] = "Yes";
 static const char msg_no[] = "No";
 
-static inline void xmodem_open_default() {
-	outportb(0xA3, xm_baudrate == 2 ? 0x08 : 0x00);
-	xmodem_open(xm_baudrate ? SERIAL_BAUD_38400 : SERIAL_BAUD_9600);
-}
-
-static const char msg_xmodem_init[] = "Initializing XMODEM transfer";
-static const char msg_xmodem_progress[] = "Transferring data";
-static const char msg_erase_progress[] = "Erasing data";
-static const char msg_xmodem_transfer_error[] = "Transfer error";
-static const char msg_xmodem_blocks_full[] = "0000/%04d";
-
-static void xmodem_status(const char *str) {
-	ui_clear_lines(6, 6);
-	ui_puts_centered(6, COLOR_BLACK, str);
-}
-
-typedef const uint8_t __far* (*xmodem_block_reader)(uint16_t block, uint16_t subblock);
-
-static void xmodem_update_counter(uint8_t x, uint8_t y, uint16_t value) {
-	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 3, y); value /= 10; if (value == 0) return;
-	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 2, y); value /= 10; if (value == 0) return;
-	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 1, y); value /= 10; if (value == 0) return;
-	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x,     y);
-}
-
-void wait_for_keypress(void) {
-	input_wait_clear(); while (input_pressed == 0) { wait_for_vblank(); input_update(); } input_wait_clear();
-}
-
-void xmodem_run_send(xmodem_block_reader reader, uint16_t blocks, uint16_t subblocks) {
-	uint16_t block_mask = (blocks >> 4); if(block_mask < 1) block_mask = 1;
-	uint16_t subblock_mask = (subblocks >> 4); if(subblock_mask < 1) subblock_mask = 1;
-
-	xmodem_status(msg_xmodem_init);
-	xmodem_open_default();
-
-	if (xmodem_send_start() == XMODEM_OK) {
-		cpu_irq_disable();
-		xmodem_status(msg_xmodem_progress);
-		ui_clear_lines(11, 11);
-		ui_printf(18, 11, COLOR_WHITE, msg_xmodem_blocks_full, blocks);
-		for (uint16_t ib = 0; ib < blocks; ib++) {
-			if (!(ib % block_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_RED) | 0x0A, 1 + (ib / block_mask), 11);
-			xmodem_update_counter(18, 11, ib+1);
-			if(subblocks > 1) {
-				ui_clear_lines(12, 12);
-				ui_printf(18, 12, COLOR_WHITE, msg_xmodem_blocks_full, subblocks);
-			}
-			for (uint16_t isb = 0; isb < subblocks; isb++) {
-				// draw block update
-				if(subblocks > 1) {
-					xmodem_update_counter(18, 12, isb+1);
-					if (!(isb % subblock_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_YELLOW) | 0x0A, 1 + (isb / subblock_mask), 12);
-				}
-
-				uint8_t result = xmodem_send_block(reader(ib, isb));
-				switch (result) {
-				case XMODEM_OK:
-					break;
-				case XMODEM_ERROR:
-					xmodem_status(msg_xmodem_transfer_error);
-					ws_hwint_ack(0xFF);
-					cpu_irq_enable();
-					wait_for_keypress();
-				case XMODEM_SELF_CANCEL:
-				case XMODEM_CANCEL:
-					goto End;
-				}
-			}
-		}
-		xmodem_send_finish();
-	}
-End:
-	ws_hwint_ack(0xFF);
-	cpu_irq_enable();
-	xmodem_close();
-	ui_clear_lines(3, 17);
-}
-
-typedef uint8_t __far* (*xmodem_block_writer)(uint16_t block, uint16_t subblock);
-typedef void (*xmodem_block_writer_finish)(uint16_t block, uint16_t subblock);
-
-void xmb_noop_write_finish(uint16_t block, uint16_t subblock) {
-
-}
-
-void xmodem_run_recv(xmodem_block_writer writer, xmodem_block_writer_finish wrf, uint16_t blocks, uint16_t subblocks, bool erase) {
-	uint16_t block_mask = (blocks >> 4); if(block_mask < 1) block_mask = 1;
-	uint16_t subblock_mask = (subblocks >> 4); if(subblock_mask < 1) subblock_mask = 1;
-
-	if(!erase) {
-		xmodem_status(msg_xmodem_init);
-		xmodem_open_default();
-	}
-	bool ack_previous = false;
-
-	cpu_irq_disable();
-	{
-		xmodem_status(erase ? msg_erase_progress : msg_xmodem_progress);
-		ui_clear_lines(11, 11);
-		ui_printf(18, 11, COLOR_WHITE, msg_xmodem_blocks_full, blocks);
-		for (uint16_t ib = 0; ib < blocks; ib++) {
-			if (!(ib % block_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_RED) | 0x0A, 1 + (ib / block_mask), 11);
-			xmodem_update_counter(18, 11, ib+1);
-			if(subblocks > 1) {
-				ui_clear_lines(12, 12);
-				ui_printf(18, 12, COLOR_WHITE, msg_xmodem_blocks_full, subblocks);
-			}
-			for (uint16_t isb = 0; isb < subblocks; isb++) {
-				// draw block update
-				if(subblocks > 1) {
-					xmodem_update_counter(18, 12, isb+1);
-					if (!(isb % subblock_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_YELLOW) | 0x0A, 1 + (isb / subblock_mask), 12);
-				}
-				if(erase) {
-					memset(writer(ib, isb), 0xFF, 128);
-					wrf(ib, isb);
-				} else {
-					uint8_t __far* block_buffer = writer(ib, isb);
-					if(!ack_previous) {
-						xmodem_recv_start();
-					}
-					uint8_t result = xmodem_recv_block(block_buffer);
-					switch (result) {
-					case XMODEM_OK:
-						wrf(ib, isb);
-						if(!erase) ack_previous = true;
-						break;
-					case XMODEM_ERROR:
-						xmodem_status(msg_xmodem_transfer_error);
-						ws_hwint_ack(0xFF);
-						cpu_irq_enable();
-						wait_for_keypress();
-					case XMODEM_SELF_CANCEL:
-					case XMODEM_CANCEL:
-						goto End;
-					case XMODEM_COMPLETE:
-						goto End;
-					}
-				}
-			}
-		}
-	}
-End:
-	ws_hwint_ack(0xFF);
-	cpu_irq_enable();
-	if(!erase) xmodem_close();
-	ui_clear_lines(3, 17);
-}
-
 static bool menu_manip_value(uint32_t *value, uint32_t command,
 	int32_t min_value, int32_t max_value,
 	int32_t prev_value, int32_t next_value,
@@ -244,6 +103,12 @@ static const char msg_backup[] = "Cart Backup \x10";
 static const char msg_restore[] = "Cart Restore \x10";
 static const char msg_erase[] = "Cart Erase \x10";
 static const char msg_flash[] = "Cart Flash (Expert) \x10";
+static const char msg_link_test[] = "Link Test...";
+static const char msg_remote[] = "Remote Control";
+#ifdef PROFILE
+static const char msg_profile[] = "Profile...";
+#endif
+static const char msg_baud_auto[] = "Serial: Auto";
 static const char msg_baud_192000[] = "Serial: 192000 bps";
 static const char msg_baud_38400[] = "Serial: _38400 bps";
 static const char msg_baud_9600[] = "Serial: __9600 bps";
@@ -251,6 +116,9 @@ static const char msg_baud_9600[] = "Serial: __9600 bps";
 static const char msg_none[] = "";
 static const char msg_rom_full[] = "ROM: %ld Mbit";
 static const char msg_rom_half[] = "ROM: %ld.5 Mbit";
+static const char msg_rom_start[] = "Start: %ld KB";
+static const char msg_rom_length[] = "Length: %ld KB";
+static const char msg_rom_length_all[] = "Length: To end";
 static const char msg_sram[] = "SRAM: %ld Kbyte";
 static const char msg_eeprom[] = "EEPROM: %ld bytes";
 
@@ -259,6 +127,9 @@ static const char msg_wait_1c[] = "Wait: 1 cycle ";
 
 static const char msg_access_8bit[] = "Access: .8-bit";
 static const char msg_access_16bit[] = "Access: 16-bit";
+static const char msg_wait_auto[] = "Wait: Auto";
+static const char msg_access_auto[] = "Access: Auto";
+static const char msg_tune_progress[] = "Tuning ROM access";
 
 static const char msg_backup_rom[] = "Backup ROM...";
 static const char msg_backup_sram[] = "Backup SRAM...";
@@ -272,61 +143,307 @@ static const char msg_erase_eeprom[] = "Erase EEPROM...";
 
 static const char msg_return[] = "\x1b Return";
 
+static const char msg_eeprom_skipped[] = "%d/%d words unchanged";
+static const char msg_eeprom_erased_all[] = "Erased with ERAL";
+
 uint16_t xmb_offset;
+// flash: FLASH_MODE_*
 uint8_t xmb_mode;
-uint8_t xmb_buffer[128];
+// added to ROM read offsets, in bytes; keeps blocks within a bank if 1 KB aligned
+uint32_t xmb_base;
+
+const uint8_t __far* xmb_ipl_read(uint32_t offset, uint16_t len) {
+	return MK_FP(0xFE00, (uint16_t) offset);
+}
+
+// banks of 64 kbytes, counted from xmb_offset
+const uint8_t __far* xmb_rom_read(uint32_t offset, uint16_t len) {
+	offset += xmb_base;
+	bank_set(BANK_ROM0, xmb_offset + (offset >> 16));
+	return MK_FP(0x2000, (uint16_t) offset);
+}
+
+// fastest first; the last entry (3 cycle wait, 8-bit) is the safest
+static const uint8_t xmb_rom_access_modes[] = {0x04, 0x0C, 0x00, 0x08};
+
+#define XMB_TUNE_SAMPLES 8
+#define XMB_TUNE_PASSES 4
+
+// read through general DMA, as the backup does
+static uint16_t xmb_rom_sample_crc(uint32_t offset) {
+	uint32_t rom_offset = offset + xmb_base;
+	bank_set(BANK_ROM0, xmb_offset + (rom_offset >> 16));
+	mem_gdma_copy(xmb_buffer, 0x2000, (uint16_t) rom_offset, XMODEM_BLOCK_SIZE_MAX);
+	return crc16(xmb_buffer, XMODEM_BLOCK_SIZE_MAX, 0);
+}
+
+/**
+ * Sample 1 KB blocks spread over the first size bytes under the safest
+ * setting, then select the fastest setting which reads them back the same
+ * way on every pass. Returns the port 0xA0 bits chosen.
+ */
+uint8_t xmb_rom_tune(uint32_t size) {
+	uint16_t reference[XMB_TUNE_SAMPLES];
+	// sample offsets stay 1 KB aligned, so no sample crosses a bank
+	uint32_t step = ((size - XMODEM_BLOCK_SIZE_MAX) / (XMB_TUNE_SAMPLES - 1)) & ~0x3FFUL;
+	uint8_t port = inportb(0xA0) & ~0x0C;
+	uint8_t safest = xmb_rom_access_modes[sizeof(xmb_rom_access_modes) - 1];
+
+	outportb(0xA0, port | safest);
+	for (uint8_t i = 0; i < XMB_TUNE_SAMPLES; i++) {
+		reference[i] = xmb_rom_sample_crc(i * step);
+	}
+
+	for (uint8_t m = 0; m < sizeof(xmb_rom_access_modes) - 1; m++) {
+		uint8_t mode = xmb_rom_access_modes[m];
+		outportb(0xA0, port | mode);
+		for (uint8_t pass = 0; pass < XMB_TUNE_PASSES; pass++) {
+			for (uint8_t i = 0; i < XMB_TUNE_SAMPLES; i++) {
+				if (xmb_rom_sample_crc(i * step) != reference[i]) goto Unstable;
+			}
+		}
+		return mode;
+Unstable:
+		;
+	}
+
+	outportb(0xA0, port | safest);
+	return safest;
+}
+
+static const char msg_checksum_progress[] = "Summing ROM";
+static const char msg_checksum_ok[] = "Header checksum OK: %04X";
+static const char msg_checksum_bad[] = "Sum %04X, header %04X";
+static const char msg_checksum_changed[] = "ROM sum changed: %04X";
 
-// block: 128 bytes
-const uint8_t __far* xmb_ipl_read(uint16_t block, uint16_t subblock) {
-	return MK_FP(0xFE00, block << 7);
+/**
+ * Sum of the bytes of the last size bytes of the ROM space, as stored in
+ * the header; the checksum word itself is left out.
+ */
+static uint16_t rom_checksum(uint32_t size) {
+	uint16_t sum = 0;
+	uint32_t start = -size;
+	for (uint32_t offset = 0; offset < size;) {
+		uint32_t rom_offset = start + offset;
+		uint32_t len = 0x10000 - (uint16_t) rom_offset;
+		if (len > size - offset) len = size - offset;
+		offset += len;
+		if (offset >= size) len -= 2;
+
+		bank_set(BANK_ROM0, rom_offset >> 16);
+		sum += mem_sum_bytes(0x2000, (uint16_t) rom_offset, len >> 1);
+	}
+	return sum;
 }
 
-// block: bank (64kbytes); subblock: 128 bytes
-const uint8_t __far* xmb_rom_read(uint16_t block, uint16_t subblock) {
-	if (subblock == 0) {
-		uint16_t bank = xmb_offset + block;
-		if (xmb_mode) outportw(IO_BANK_2003_ROM0, bank);
-		outportb(IO_BANK_ROM0, bank);
+static uint16_t rom_header_checksum(void) {
+	bank_set(BANK_ROM0, 0xFFFF);
+	return *((uint16_t __far*) MK_FP(0x2FFF, 0xE));
+}
+
+/**
+ * Compare the sum of the last size bytes of ROM against the header,
+ * showing the result on line y. Returns the sum.
+ */
+static uint16_t rom_checksum_show(uint32_t size, uint8_t y) {
+	xmodem_status(msg_checksum_progress);
+	uint16_t sum = rom_checksum(size);
+	uint16_t header = rom_header_checksum();
+	ui_clear_lines(6, 6);
+	ui_clear_lines(y, y);
+	if (sum == header) {
+		ui_printf(1, y, COLOR_WHITE, msg_checksum_ok, sum);
+	} else {
+		ui_printf(1, y, COLOR_RED, msg_checksum_bad, sum, header);
 	}
-	return MK_FP(0x2000, subblock << 7);
+	return sum;
 }
 
-// block: 8kbytes; subblock: 128 bytes
-uint8_t __far* xmb_sram_read(uint16_t block, uint16_t subblock) {
-	uint16_t bank = block >> 3;
-	uint16_t subbank = block & 0x07; /* 8KB units */
-	if (subbank == 0) {
-		bank += xmb_offset;
-		if(xmb_mode) outportw(IO_BANK_2003_RAM, bank);
-		outportb(IO_BANK_RAM, bank);
+#define XMB_CHECK_REPORT_MAX 12
+
+static const char msg_check_progress[] = "Checking ROM reads";
+static const char msg_check_unstable[] = "Unstable banks: %u";
+static const char msg_check_bank[] = "%04X";
+static const char msg_check_continue[] = "Back up anyway?";
+
+/**
+ * Read every bank of the range twice, as xmb_rom_read maps it, and compare
+ * checksums. Returns true if all banks read back the same, or if the user
+ * chooses to go ahead regardless.
+ */
+bool xmb_rom_check(uint32_t size) {
+	uint16_t unstable[XMB_CHECK_REPORT_MAX];
+	uint16_t unstable_count = 0;
+	uint16_t pieces = ((xmb_base + size - 1) >> 16) - (xmb_base >> 16) + 1;
+
+	xmodem_status(msg_check_progress);
+	xmodem_progress_init((uint32_t) pieces << 7, 7);
+	uint16_t piece = 0;
+	for (uint32_t offset = 0; offset < size; piece++) {
+		xmodem_progress_update((uint32_t) piece << 7);
+		uint32_t rom_offset = offset + xmb_base;
+		uint32_t len = 0x10000 - (uint16_t) rom_offset;
+		if (len > size - offset) len = size - offset;
+
+		uint16_t bank = xmb_offset + (rom_offset >> 16);
+		bank_set(BANK_ROM0, bank);
+		uint32_t first = mem_checksum_words(0x2000, (uint16_t) rom_offset, len >> 1);
+		if (mem_checksum_words(0x2000, (uint16_t) rom_offset, len >> 1) != first) {
+			if (unstable_count < XMB_CHECK_REPORT_MAX) unstable[unstable_count] = bank;
+			unstable_count++;
+		}
+		offset += len;
 	}
-	return MK_FP(0x1000 | (subbank << 9), subblock << 7);
+	xmodem_progress_end();
+	ui_clear_lines(3, 17);
+	if (!unstable_count) return true;
+
+	ui_printf(1, 4, COLOR_RED, msg_check_unstable, unstable_count);
+	for (uint8_t i = 0; i < unstable_count && i < XMB_CHECK_REPORT_MAX; i++) {
+		ui_printf(1 + (i % 6) * 5, 5 + (i / 6), COLOR_WHITE, msg_check_bank, unstable[i]);
+	}
+	bool result = menu_confirm(msg_check_continue, 1, true);
+	ui_clear_lines(3, 17);
+	return result;
+}
+
+// ROM blocks are staged into internal RAM by general DMA; the block after
+// the one being sent is fetched while waiting for the host's ACK.
+static uint8_t xmb_stage[2][XMODEM_BLOCK_SIZE_MAX] __attribute__((aligned(2)));
+static uint32_t xmb_stage_offset[2];
+static uint16_t xmb_stage_len[2];
+static uint8_t xmb_stage_next;
+static uint32_t xmb_stage_size;
+static uint32_t xmb_stage_prefetch;
+
+void xmb_rom_stage_init(uint32_t size) {
+	xmb_stage_len[0] = 0;
+	xmb_stage_len[1] = 0;
+	xmb_stage_next = 0;
+	xmb_stage_size = size;
+	xmb_stage_prefetch = size;
 }
 
-// block: eeprom 128b, no subblocks
-const uint8_t __far* xmb_eeprom_read(uint16_t block, uint16_t subblock) {
+static void xmb_rom_stage(uint32_t offset, uint16_t len) {
+	uint8_t slot = xmb_stage_next;
+	uint32_t rom_offset = offset + xmb_base;
+	bank_set(BANK_ROM0, xmb_offset + (rom_offset >> 16));
+	mem_gdma_copy(xmb_stage[slot], 0x2000, (uint16_t) rom_offset, len);
+	xmb_stage_offset[slot] = offset;
+	xmb_stage_len[slot] = len;
+	xmb_stage_next = slot ^ 1;
+}
+
+const uint8_t __far* xmb_rom_read_staged(uint32_t offset, uint16_t len) {
+	uint8_t slot;
+	for (slot = 0; slot < 2; slot++) {
+		if (xmb_stage_offset[slot] == offset && xmb_stage_len[slot] >= len) goto Found;
+	}
+	xmb_rom_stage(offset, len);
+	slot = xmb_stage_next ^ 1;
+Found:
+	xmb_stage_prefetch = offset + len;
+	return xmb_stage[slot];
+}
+
+// idle hook: fill the other slot with the largest block that may come next
+void xmb_rom_prefetch(void) {
+	uint32_t offset = xmb_stage_prefetch;
+	if (offset >= xmb_stage_size) return;
+	xmb_stage_prefetch = xmb_stage_size;
+
+	uint16_t len = XMODEM_BLOCK_SIZE_MAX;
+	uint16_t bank_left = 0x10000 - (uint16_t) (offset + xmb_base);
+	if (bank_left && bank_left < len) len = bank_left;
+	if (xmb_stage_size - offset < len) len = xmb_stage_size - offset;
+	xmb_rom_stage(offset, len);
+}
+
+static uint8_t __far* xmb_sram_map(uint32_t offset) {
+	bank_set(BANK_RAM, xmb_offset + (offset >> 16));
+	return MK_FP(0x1000, (uint16_t) offset);
+}
+
+const uint8_t __far* xmb_sram_read(uint32_t offset, uint16_t len) {
+	return xmb_sram_map(offset);
+}
+
+void xmb_sram_write(uint32_t offset, const uint8_t *data, uint16_t len) {
+	uint8_t __far* dest = xmb_sram_map(offset);
+	while (len--) {
+		*(dest++) = *(data++);
+	}
+}
+
+void xmb_sram_erase(uint32_t size) {
+	uint16_t banks = (size + 0xFFFF) >> 16;
+
+	xmodem_status(msg_erase_progress);
+	// one progress step per bank
+	xmodem_progress_init((uint32_t) banks << 7, 7);
+	for (uint16_t bank = 0; bank < banks; bank++) {
+		xmodem_progress_update((uint32_t) bank << 7);
+		uint32_t left = size - ((uint32_t) bank << 16);
+		xmb_sram_map((uint32_t) bank << 16);
+		mem_fill_words(0x1000, 0, 0xFFFF, left >= 0x10000 ? 0x8000 : (left >> 1));
+	}
+	xmodem_progress_end();
+	ui_clear_lines(3, 17);
+}
+
+const uint8_t __far* xmb_eeprom_read(uint32_t offset, uint16_t len) {
 	ws_eeprom_handle_t h = ws_eeprom_handle_cartridge(xmb_offset);
 	uint16_t *ptr = (uint16_t*) xmb_buffer;
-	uint16_t p = (block << 7);
-	for (uint16_t i = 0; i < 128; i += 2, p += 2) {
+	uint16_t p = offset;
+	for (uint16_t i = 0; i < len; i += 2, p += 2) {
 		*(ptr++) = ws_eeprom_read_word(h, p);
 	}
 	return xmb_buffer;
 }
 
-uint8_t __far* xmb_eeprom_write(uint16_t block, uint16_t subblock) {
-	return xmb_buffer;
-}
+uint16_t xmb_eeprom_words;
+uint16_t xmb_eeprom_skipped;
 
-void xmb_eeprom_write_finish(uint16_t block, uint16_t subblock) {
+// each EEPROM write takes milliseconds; only write words which differ
+void xmb_eeprom_write(uint32_t offset, const uint8_t *data, uint16_t len) {
 	ws_eeprom_handle_t h = ws_eeprom_handle_cartridge(xmb_offset);
-	ws_eeprom_write_unlock(h);
-	uint16_t *ptr = (uint16_t*) xmb_buffer;
-	uint16_t p = (block << 7);
-	for (uint16_t i = 0; i < 128; i += 2, p += 2) {
-		ws_eeprom_write_word(h, p, *(ptr++));
+	bool unlocked = false;
+	const uint16_t *ptr = (const uint16_t*) data;
+	uint16_t p = offset;
+	for (uint16_t i = 0; i < len; i += 2, p += 2, ptr++) {
+		xmb_eeprom_words++;
+		if (ws_eeprom_read_word(h, p) == *ptr) {
+			xmb_eeprom_skipped++;
+			continue;
+		}
+		if (!unlocked) {
+			ws_eeprom_write_unlock(h);
+			unlocked = true;
+		}
+		ws_eeprom_write_word(h, p, *ptr);
+	}
+	if (unlocked) {
+		ws_eeprom_write_lock(h);
+	}
+}
+
+// returns true if the chip was erased with a single ERAL command
+bool xmb_eeprom_erase(uint16_t bytes) {
+	xmodem_status(msg_erase_progress);
+	if (bytes && eeprom_erase_all(xmb_offset)) {
+		ui_clear_lines(3, 17);
+		return true;
+	}
+
+	// word by word, leaving already blank words alone
+	xmb_eeprom_words = 0;
+	xmb_eeprom_skipped = 0;
+	memset(xmb_buffer, 0xFF, XMODEM_BLOCK_SIZE);
+	for (uint16_t p = 0; p < bytes; p += XMODEM_BLOCK_SIZE) {
+		xmb_eeprom_write(p, xmb_buffer, XMODEM_BLOCK_SIZE);
 	}
-	ws_eeprom_write_lock(h);
+	ui_clear_lines(3, 17);
+	return false;
 }
 
 static const uint16_t rom_bank_values[] = {
@@ -334,19 +451,33 @@ static const uint16_t rom_bank_values[] = {
 };
 
 void menu_backup(bool restore, bool erase) {
-	char buf_rom[21], buf_sram[21], buf_eeprom[21], buf_wait[15], buf_access[15];
+	char buf_rom[21], buf_rom_start[21], buf_rom_length[21];
+	char buf_sram[21], buf_eeprom[21], buf_wait[15], buf_access[15];
 	menu_state_t state;
-	menu_entry_t entries[11];
+	menu_entry_t entries[13];
 	uint8_t entry_count = 0;
 
 	uint32_t rom_banks = 256;
+	// pick the 0xA0 wait state/width bits before each ROM backup
+	bool rom_tune = !restore;
+	// in kilobytes from the start of the ROM image; a zero length reads to the end
+	uint32_t rom_start = 0;
+	uint32_t rom_length = 0;
 	uint32_t sram_kbytes = 0;
 	uint32_t eeprom_bytes = 0;
+	// a host with a cartridge database knows better than the header; it is
+	// asked once, when a backup starts at the automatic rate (the query goes
+	// out at 9600 bps), and not at all once a size was set by hand
+	bool sizes_asked = restore || xm_baudrate != XMODEM_RATE_AUTO;
 
 	// generate menu entry list
 	if (!restore) {
 		entries[entry_count].text = buf_rom;
 		entries[entry_count++].flags = MENU_ENTRY_ADJUSTABLE | MENU_ENTRY_ADJUSTABLE_ADV;
+		entries[entry_count].text = buf_rom_start;
+		entries[entry_count++].flags = MENU_ENTRY_ADJUSTABLE | MENU_ENTRY_ADJUSTABLE_ADV;
+		entries[entry_count].text = buf_rom_length;
+		entries[entry_count++].flags = MENU_ENTRY_ADJUSTABLE | MENU_ENTRY_ADJUSTABLE_ADV;
 	}
 	entries[entry_count].text = buf_sram;
 	entries[entry_count++].flags = MENU_ENTRY_ADJUSTABLE | MENU_ENTRY_ADJUSTABLE_ADV;
@@ -377,10 +508,7 @@ void menu_backup(bool restore, bool erase) {
 	ui_menu_init(&state);
 
 	// determine banks, reset
-	outportw(IO_BANK_2003_ROM0, 0xFFFF);
-	outportb(IO_BANK_ROM0, 0xFF);
-	outportw(IO_BANK_2003_RAM, 0xFFFF);
-	outportb(IO_BANK_RAM, 0xFF);
+	bank_reset();
 
 	uint8_t rom_bank_idx = *((uint8_t __far*) MK_FP(0x2FFF, 0xA));
 	if (rom_bank_idx <= 11) rom_banks = rom_bank_values[rom_bank_idx];
@@ -400,18 +528,50 @@ void menu_backup(bool restore, bool erase) {
 		// update ROM/SRAM/EEPROM strings
 		if (!restore) {
 			snprintf(buf_rom, sizeof(buf_rom), (rom_banks & 1) ? msg_rom_half : msg_rom_full, rom_banks >> 1);
+			if (rom_start >= (rom_banks << 6)) rom_start = (rom_banks << 6) - 1;
+			if (rom_length > (rom_banks << 6) - rom_start) rom_length = (rom_banks << 6) - rom_start;
+			snprintf(buf_rom_start, sizeof(buf_rom_start), msg_rom_start, rom_start);
+			if (rom_length) {
+				snprintf(buf_rom_length, sizeof(buf_rom_length), msg_rom_length, rom_length);
+			} else {
+				strcpy(buf_rom_length, msg_rom_length_all);
+			}
 		}
 		snprintf(buf_sram, sizeof(buf_sram), msg_sram, sram_kbytes);
 		snprintf(buf_eeprom, sizeof(buf_eeprom), msg_eeprom, eeprom_bytes);
-		strcpy(buf_wait, (inportb(0xA0) & 0x08) ? msg_wait_3c : msg_wait_1c);
-		strcpy(buf_access, (inportb(0xA0) & 0x04) ? msg_access_16bit : msg_access_8bit);
+		if (rom_tune) {
+			strcpy(buf_wait, msg_wait_auto);
+			strcpy(buf_access, msg_access_auto);
+		} else {
+			strcpy(buf_wait, (inportb(0xA0) & 0x08) ? msg_wait_3c : msg_wait_1c);
+			strcpy(buf_access, (inportb(0xA0) & 0x04) ? msg_access_16bit : msg_access_8bit);
+		}
 
 		uint16_t result = ui_menu_run(&state, 3 + ((14 - entry_count) >> 1));
 		if (restore) {
 			result++;
 			if ((result & 0xFF) > 5) result++;
+		} else if ((result & 0xFF) >= 1 && (result & 0xFF) <= 2) {
+			// ROM range entries
+			result += 9;
+		} else if ((result & 0xFF) > 2) {
+			result -= 2;
 		}
-		switch (result & 0xFF) {
+		uint8_t action = result & 0xFF;
+		if (action <= 2) {
+			sizes_asked = true;
+		} else if (action >= 6 && action <= 8 && !sizes_asked) {
+			sizes_asked = true;
+			xmodem_cart_sizes_t sizes;
+			if (xmodem_query_sizes(MK_FP(0x2FFF, 0x0), &sizes)) {
+				rom_banks = sizes.rom_banks;
+				sram_kbytes = sizes.sram_kbytes;
+				eeprom_bytes = sizes.eeprom_bytes;
+				if (rom_start >= (rom_banks << 6)) rom_start = (rom_banks << 6) - 1;
+				if (rom_length > (rom_banks << 6) - rom_start) rom_length = (rom_banks << 6) - rom_start;
+			}
+		}
+		switch (action) {
 		case 0: {
 			menu_manip_value(&rom_banks, result, 1, 1024,
 				rom_banks >> 1, rom_banks << 1,
@@ -429,38 +589,107 @@ void menu_backup(bool restore, bool erase) {
 				eeprom_bytes >> 1, eeprom_bytes << 1,
 				0, 0, 0, 0, true);
 		} break;
+		// backups cycle Auto -> slow -> fast -> Auto
 		case 3: {
-			outportb(0xA0, inportb(0xA0) ^ 0x08);
+			if (rom_tune) {
+				rom_tune = false;
+				outportb(0xA0, inportb(0xA0) | 0x08);
+			} else if (!restore && !(inportb(0xA0) & 0x08)) {
+				rom_tune = true;
+			} else {
+				outportb(0xA0, inportb(0xA0) ^ 0x08);
+			}
 		} break;
 		case 4: {
-			outportb(0xA0, inportb(0xA0) ^ 0x04);
+			if (rom_tune) {
+				rom_tune = false;
+				outportb(0xA0, inportb(0xA0) & ~0x04);
+			} else if (!restore && (inportb(0xA0) & 0x04)) {
+				rom_tune = true;
+			} else {
+				outportb(0xA0, inportb(0xA0) ^ 0x04);
+			}
 		} break;
 		case 6: {
 			xmb_offset = -rom_banks;
-			xmb_mode = rom_banks > 256 ? 1 : 0;
 			if (!restore) {
-				xmodem_run_send(xmb_rom_read, rom_banks, 512);
+				uint32_t kbytes = rom_length ? rom_length : (rom_banks << 6) - rom_start;
+				xmb_base = rom_start << 10;
+				if (rom_tune) {
+					xmodem_status(msg_tune_progress);
+					xmb_rom_tune(kbytes << 10);
+				}
+				// the header sum covers the whole ROM; summing it would take
+				// longer than a partial backup itself
+				bool whole = kbytes == (rom_banks << 6);
+				uint16_t sum = 0;
+				bool proceed = true;
+				if (whole) {
+					sum = rom_checksum_show(rom_banks << 16, 3);
+					proceed = sum == rom_header_checksum()
+						|| menu_confirm(msg_check_continue, 1, true);
+					ui_clear_lines(3, 17);
+				}
+				if (proceed && xmb_rom_check(kbytes << 10)) {
+					xmb_rom_stage_init(kbytes << 10);
+					xmodem_set_idle_hook(xmb_rom_prefetch);
+					// count banks when reading whole banks, kilobytes otherwise
+					xmodem_run_send(xmb_rom_read_staged, kbytes << 10,
+						((rom_start | kbytes) & 0x3F) ? 10 : 16);
+					xmodem_set_idle_hook(NULL);
+
+					// the cart moving mid-dump shows up here
+					if (whole) {
+						xmodem_status(msg_checksum_progress);
+						uint16_t sum_after = rom_checksum(rom_banks << 16);
+						ui_clear_lines(3, 17);
+						if (sum_after != sum) {
+							ui_printf(1, 16, COLOR_RED, msg_checksum_changed, sum_after);
+						}
+					}
+				}
+				xmb_base = 0;
 			}
 		} break;
 		case 7: {
 			uint16_t sram_banks = ((sram_kbytes + 63) >> 6);
 			xmb_offset = -sram_banks;
-			xmb_mode = sram_banks > 256 ? 1 : 0;
 			if (!restore) {
-				xmodem_run_send(xmb_sram_read, sram_kbytes >> 3, 64);
+				xmodem_run_send(xmb_sram_read, sram_kbytes << 10, 13);
+			} else if (erase) {
+				xmb_sram_erase(sram_kbytes << 10);
 			} else {
-				xmodem_run_recv(xmb_sram_read, xmb_noop_write_finish, sram_kbytes >> 3, 64, erase);
+				xmodem_run_recv(xmb_sram_write, sram_kbytes << 10, 13, false);
 			}
 		} break;
 		case 8: {
 			xmb_offset = eeprom_bytes <= 128 ? 6 : (eeprom_bytes <= 512 ? 8 : 10);
 			if (!restore) {
-				xmodem_run_send(xmb_eeprom_read, eeprom_bytes >> 7, 1);
+				xmodem_run_send(xmb_eeprom_read, eeprom_bytes, 7);
+			} else if (erase && xmb_eeprom_erase(eeprom_bytes)) {
+				ui_puts(0, 16, COLOR_GRAY, msg_eeprom_erased_all);
 			} else {
-				xmodem_run_recv(xmb_eeprom_write, xmb_eeprom_write_finish, eeprom_bytes >> 7, 1, erase);
+				if (!erase) {
+					xmb_eeprom_words = 0;
+					xmb_eeprom_skipped = 0;
+					xmodem_run_recv(xmb_eeprom_write, eeprom_bytes, 7, false);
+				}
+				ui_printf(0, 16, COLOR_GRAY, msg_eeprom_skipped, xmb_eeprom_skipped, xmb_eeprom_words);
 			}
 		} break;
 		case 9: return;
+		case 10: {
+			menu_manip_value(&rom_start, result, 1, (rom_banks << 6) - 1,
+				rom_start - 64, rom_start + 64,
+				rom_start - 1, rom_start + 1,
+				rom_start - 1024, rom_start + 1024, true);
+		} break;
+		case 11: {
+			menu_manip_value(&rom_length, result, 1, (rom_banks << 6) - rom_start,
+				rom_length - 64, rom_length + 64,
+				rom_length - 1, rom_length + 1,
+				rom_length - 1024, rom_length + 1024, true);
+		} break;
 		}
 	}
 }
@@ -477,36 +706,157 @@ static const char msg_flash_warn_unbootable_1[] = "Warning: Header not bootable"
 static const char msg_flash_warn_unbootable_2[] = "Console will not boot with";
 static const char msg_flash_warn_unbootable_3[] = "this cartridge inserted.";
 
+static const char msg_flash_failed[] = "Failed banks: %u";
+static const char msg_flash_redo[] = "Resend image to redo them?";
+static const char msg_patch_flash[] = "Apply IPS Patch...";
+static const char msg_patch_warn_sram[] = "SRAM will be overwritten!";
+static const char msg_patch_banks[] = "Banks rewritten: %u";
+static const char msg_patch_runs[] = "Written in place: %u";
+static const char msg_patch_ok[] = "Patch applied";
+static const char msg_patch_incomplete[] = "Patch incomplete";
+static const char msg_patch_format[] = "Not an IPS patch";
+static const char msg_patch_range[] = "Patch exceeds image size";
+static const char msg_patch_verify[] = "Verify failed";
+static const char msg_patch_sram[] = "Needs 64 KB of SRAM";
+static const char msg_patch_flash_failed[] = "Flash erase/write failed";
+static const char* const msg_patch_results[] = {
+	msg_patch_ok, msg_patch_incomplete, msg_patch_format, msg_patch_range, msg_patch_verify,
+	msg_patch_sram, msg_patch_flash_failed
+};
+
 // return offset
 static uint16_t xmf_acquire_kbyte(uint16_t kbyte) {
-	uint16_t bank = 0xFC00 | ((xmb_offset + kbyte) >> 6);
-	outportw(IO_BANK_2003_RAM, bank);
-	outportb(IO_BANK_RAM, bank);
-	return (kbyte << 10);
+	bank_set(BANK_RAM, 0xFC00 | ((xmb_offset + kbyte) >> 6));
+	return ((xmb_offset + kbyte) << 10);
 }
 
-uint8_t __far* xmf_write(uint16_t block, uint16_t subblock) {
-	return xmb_buffer;
+#define XMF_KBYTES_MAX 8192
+// an image not aligned to 64 KB touches one bank more
+#define XMF_BANKS_MAX ((XMF_KBYTES_MAX >> 6) + 1)
+// erase commands are issued per 8 KB, the smallest sector of supported chips
+#define XMF_ERASE_SIZE 0x2000
+#define XMF_CHUNK_SIZE 128
+#define XMF_NO_BANK 0xFFFF
+
+// banks counted from the one holding the first kbyte of the image
+static uint8_t xmf_failed[(XMF_BANKS_MAX + 7) >> 3];
+static uint8_t xmf_redo[(XMF_BANKS_MAX + 7) >> 3];
+static uint32_t xmf_size;
+static bool xmf_repair;
+static uint16_t xmf_repair_bank;
+
+static uint16_t xmf_bank(uint32_t offset) {
+	return ((xmb_offset & 0x3F) + (uint16_t) (offset >> 10)) >> 6;
+}
+
+// the flash is read back through the RAM window it is written through
+static bool xmf_region_blank(uint16_t offset) {
+	const uint16_t __far* p = MK_FP(0x1000, offset);
+	for (uint16_t i = 0; i < (XMF_ERASE_SIZE >> 1); i++) {
+		if (p[i] != 0xFFFF) return false;
+	}
+	return true;
 }
 
-void xmf_erase_finish(uint16_t block, uint16_t subblock) {
-	if (subblock == 0) {
-		uint16_t offset = xmf_acquire_kbyte(block);
-		flash_erase(offset, xmb_mode);
+// erases the region holding offset (within the mapped bank) unless blank
+static bool xmf_erase_region(uint16_t offset) {
+	offset &= ~(XMF_ERASE_SIZE - 1);
+	if (xmf_region_blank(offset)) return true;
+	uint32_t start = timer_ticks();
+	bool result = false;
+	// a failed erase leaves the sector partly programmed; one more try
+	for (uint8_t tries = 0; tries < 2 && !result; tries++) {
+		PROFILE_BEGIN(PROFILE_FLASH_ERASE);
+		result = flash_erase(offset, xmb_mode) && xmf_region_blank(offset);
+		PROFILE_END(PROFILE_FLASH_ERASE);
 	}
+	xmodem_stats.flash_erase_ticks += timer_ticks() - start;
+	return result;
 }
 
-void xmf_write_finish(uint16_t block, uint16_t subblock) {
+static bool xmf_program(const uint8_t *data, uint16_t offset, uint16_t len) {
+	PROFILE_BEGIN(PROFILE_FLASH_WRITE);
+	bool result = flash_write(data, offset, len, xmb_mode);
+	PROFILE_END(PROFILE_FLASH_WRITE);
+	const uint8_t __far* flash = MK_FP(0x1000, offset);
+	for (uint16_t i = 0; i < len && result; i++) {
+		if (flash[i] != data[i]) result = false;
+	}
+	return result;
+}
+
+void xmf_init(uint32_t size) {
+	xmf_size = size;
+	memset(xmf_failed, 0, sizeof(xmf_failed));
+	xmf_repair = false;
+}
+
+void xmf_erase(uint32_t offset, const uint8_t *data, uint16_t len) {
+	// a sector erase clears its neighbours too; regions found blank are skipped,
+	// so each sector is erased once whatever its size
+	if ((offset & 0x3FF) || (offset && ((xmb_offset + (offset >> 10)) & 7))) return;
+	if (!xmf_erase_region(xmf_acquire_kbyte(offset >> 10))) {
+		uint16_t bank = xmf_bank(offset);
+		xmf_failed[bank >> 3] |= 1 << (bank & 7);
+	}
+}
+
+void xmf_write(uint32_t offset, const uint8_t *data, uint16_t len) {
 	// NOTES:
 	// - MX29L3211 expects writes within a 256-byte page
-	uint16_t offset = xmf_acquire_kbyte(block);
-	flash_write(xmb_buffer, offset + (subblock << 7), 128, xmb_mode);
+	uint16_t bank = xmf_bank(offset);
+	uint8_t mask = 1 << (bank & 7);
+	uint16_t kbyte_offset = xmf_acquire_kbyte(offset >> 10) + (offset & 0x3FF);
+	if (xmf_repair) {
+		// only banks which failed last time are written; the image's part
+		// of each is erased again when its first block arrives
+		if (!(xmf_redo[bank >> 3] & mask)) return;
+		if (bank != xmf_repair_bank) {
+			xmf_repair_bank = bank;
+			uint32_t end = (uint32_t) kbyte_offset + (xmf_size - offset);
+			for (uint32_t region = kbyte_offset & ~(XMF_ERASE_SIZE - 1);
+				region < 0x10000 && region < end; region += XMF_ERASE_SIZE) {
+				if (!xmf_erase_region((uint16_t) region)) {
+					xmf_failed[bank >> 3] |= mask;
+					break;
+				}
+			}
+		}
+	}
+	// the rest of a failed bank is left for the repair pass
+	if (xmf_failed[bank >> 3] & mask) return;
+
+	uint32_t start = timer_ticks();
+	for (uint16_t i = 0; i < len; i += XMF_CHUNK_SIZE) {
+		uint16_t chunk = len - i < XMF_CHUNK_SIZE ? len - i : XMF_CHUNK_SIZE;
+		// programming the same data again only clears bits that did not take
+		if (!xmf_program(data + i, kbyte_offset + i, chunk)
+			&& !xmf_program(data + i, kbyte_offset + i, chunk)) {
+			xmf_failed[bank >> 3] |= mask;
+			break;
+		}
+	}
+	xmodem_stats.flash_program_ticks += timer_ticks() - start;
+}
+
+// returns the number of banks which failed to erase or program; another
+// xmf_write pass of the same image then redoes only those banks
+uint16_t xmf_write_finish(void) {
+	uint16_t count = 0;
+	for (uint8_t i = 0; i < sizeof(xmf_failed); i++) {
+		xmf_redo[i] = xmf_failed[i];
+		for (uint8_t bits = xmf_failed[i]; bits; bits &= bits - 1) count++;
+		xmf_failed[i] = 0;
+	}
+	xmf_repair = count != 0;
+	xmf_repair_bank = XMF_NO_BANK;
+	return count;
 }
 
 void menu_flash(void) {
 	char buf_offset_from_end[30], buf_kbytes[30];
 	menu_state_t state;
-	menu_entry_t entries[6];
+	menu_entry_t entries[7];
 	uint8_t entry_count;
 
 	uint32_t offset_from_end = 0;
@@ -516,10 +866,7 @@ void menu_flash(void) {
 menu_flash_init:
 	entry_count = 0;
 
-	outportw(IO_BANK_2003_ROM0, 0xFFFF);
-	outportb(IO_BANK_ROM0, 0xFF);
-	outportw(IO_BANK_2003_RAM, 0xFFFF);
-	outportb(IO_BANK_RAM, 0xFF);
+	bank_reset();
 
 	// check bootability
 	uint8_t __far *rom_header = MK_FP(0x2FFF, 0);
@@ -542,6 +889,8 @@ menu_flash_init:
 	entries[entry_count++].flags = MENU_ENTRY_DISABLED;
 	entries[entry_count].text = msg_write_flash;
 	entries[entry_count++].flags = 0;
+	entries[entry_count].text = msg_patch_flash;
+	entries[entry_count++].flags = 0;
 	entries[entry_count].text = msg_return;
 	entries[entry_count++].flags = 0;
 	state.entries = entries; state.entry_count = entry_count;
@@ -565,7 +914,7 @@ menu_flash_init:
 				offset_from_end - 1024, offset_from_end + 1024, false);
 			break;
 		case 1:
-			menu_manip_value(&kbytes, result, 1, 8192,
+			menu_manip_value(&kbytes, result, 1, XMF_KBYTES_MAX,
 				kbytes >> 1, kbytes << 1,
 				kbytes - 1, kbytes + 1,
 				kbytes - 64, kbytes + 64, false);
@@ -581,20 +930,85 @@ menu_flash_init:
 
 			outportb(IO_CART_FLASH, 0x01);
 
-			xmodem_run_recv(xmf_write, xmf_erase_finish, kbytes, 8, true);
-			xmodem_run_recv(xmf_write, xmf_write_finish, kbytes, 8, false);
+			xmf_init(kbytes << 10);
+			xmodem_run_recv(xmf_erase, kbytes << 10, 10, true);
+			xmodem_run_recv(xmf_write, kbytes << 10, 10, false);
+
+			uint16_t failed;
+			while ((failed = xmf_write_finish()) != 0) {
+				ui_printf(1, 4, COLOR_RED, msg_flash_failed, failed);
+				if (!menu_confirm(msg_flash_redo, 1, true)) break;
+				ui_clear_lines(3, 17);
+				xmodem_run_recv(xmf_write, kbytes << 10, 10, false);
+			}
+			ui_clear_lines(3, 17);
 
 			outportb(IO_CART_FLASH, 0x00);
+			if (!offset_from_end) {
+				// the image ends at the header; check it as the console would see it
+				rom_checksum_show(kbytes << 10, 8);
+				wait_for_keypress();
+				ui_clear_lines(3, 17);
+			}
 			goto menu_flash_init;
 		case 5:
+			ui_clear_lines(3, 17);
+			if (menu_confirm(msg_patch_warn_sram, 1, true)) {
+				patch_ips_init((offset_from_end ^ 0xFFFF) - (kbytes - 1), kbytes, mode);
+				if (patch_status.result == PATCH_OK) {
+					xmodem_run_recv(patch_ips_write, kbytes << 10, 10, false);
+				}
+				uint8_t result = patch_ips_finish();
+				ui_puts_centered(6, COLOR_BLACK, msg_patch_results[result]);
+				ui_printf(1, 8, COLOR_WHITE, msg_patch_banks, patch_status.banks_rewritten);
+				ui_printf(1, 9, COLOR_WHITE, msg_patch_runs, patch_status.runs_in_place);
+				wait_for_keypress();
+			}
+			ui_clear_lines(3, 17);
+			goto menu_flash_init;
+		case 6:
 			return;
 		}
 	}
 }
 
+static const char msg_link_test_progress[] = "Testing link (host echo)";
+static const char msg_link_test_header[] = "   Rate    B/s Rty Err T/O";
+static const char msg_link_test_row[] = "%6ld %6u %3u %3u %3u";
+static const char msg_link_test_unreachable[] = "%6ld   switch not echoed";
+static const char msg_link_test_best[] = "Using %ld bps";
+
+static const uint32_t xm_baudrate_values[] = {
+	9600, 38400, 192000
+};
+
+void menu_link_test(void) {
+	linktest_result_t results[XMODEM_RATE_COUNT];
+
+	ui_clear_lines(3, 17);
+	xmodem_status(msg_link_test_progress);
+	xm_baudrate = linktest_run(results);
+
+	ui_clear_lines(6, 6);
+	ui_puts(1, 6, 0, msg_link_test_header);
+	for (uint8_t i = 0; i < XMODEM_RATE_COUNT; i++) {
+		if (results[i].unreachable) {
+			ui_printf(1, 7 + i, COLOR_RED, msg_link_test_unreachable, xm_baudrate_values[i]);
+		} else {
+			ui_printf(1, 7 + i, COLOR_WHITE, msg_link_test_row, xm_baudrate_values[i],
+				results[i].bytes_per_second, results[i].retries,
+				results[i].checksum_errors, results[i].timeouts);
+		}
+	}
+	ui_printf(1, 11, COLOR_YELLOW, msg_link_test_best, xm_baudrate_values[xm_baudrate]);
+
+	wait_for_keypress();
+	ui_clear_lines(3, 17);
+}
+
 uint16_t menu_show_main(void) {
 	menu_state_t state;
-	menu_entry_t entries[6];
+	menu_entry_t entries[9];
 	uint8_t entry_count = 0;
 
 	entries[entry_count].text = msg_send_ipl;
@@ -607,6 +1021,14 @@ uint16_t menu_show_main(void) {
 	entries[entry_count++].flags = 0;
 	entries[entry_count].text = msg_flash;
 	entries[entry_count++].flags = 0;
+	entries[entry_count].text = msg_link_test;
+	entries[entry_count++].flags = 0;
+	entries[entry_count].text = msg_remote;
+	entries[entry_count++].flags = 0;
+#ifdef PROFILE
+	entries[entry_count].text = msg_profile;
+	entries[entry_count++].flags = 0;
+#endif
 	entries[entry_count].text = msg_baud_38400;
 	entries[entry_count++].flags = 0;
 	state.entries = entries; state.entry_count = entry_count;
@@ -615,11 +1037,16 @@ uint16_t menu_show_main(void) {
 	uint16_t result;
 	bool active = true;
 	while (active) {	
-		entries[entry_count - 1].text = (xm_baudrate == 2) ? msg_baud_192000 : ((xm_baudrate == 1) ? msg_baud_38400 : msg_baud_9600);
+		switch (xm_baudrate) {
+		case XMODEM_RATE_AUTO: entries[entry_count - 1].text = msg_baud_auto; break;
+		case XMODEM_RATE_192000: entries[entry_count - 1].text = msg_baud_192000; break;
+		case XMODEM_RATE_38400: entries[entry_count - 1].text = msg_baud_38400; break;
+		default: entries[entry_count - 1].text = msg_baud_9600; break;
+		}
 		result = ui_menu_run(&state, 3 + ((14 - entry_count) >> 1));
 		if (result == entry_count - 1) {
 			if (xm_baudrate == 0)
-				xm_baudrate = 2;
+				xm_baudrate = XMODEM_RATE_AUTO;
 			else
 				xm_baudrate = xm_baudrate - 1;
 		} else {
@@ -643,13 +1070,252 @@ bool check_transfer_ipl(void) {
 	return !ipl_locked;
 }
 
+static const char msg_remote_active[] = "Remote control active";
+static const char msg_remote_exit[] = "Hold B to exit";
+static const char msg_remote_count[] = "%u commands";
+
+static uint8_t remote_flash_mode;
+static uint8_t remote_eeprom_bits;
+
+static uint8_t __far* remote_map(uint8_t space, uint32_t address) {
+	if (space == REMOTE_SPACE_ROM) {
+		bank_set(BANK_ROM0, address >> 16);
+		return MK_FP(0x2000, (uint16_t) address);
+	} else {
+		bank_set(BANK_RAM, address >> 16);
+		return MK_FP(0x1000, (uint16_t) address);
+	}
+}
+
+static bool remote_range_valid(uint8_t space, uint32_t address, uint32_t len) {
+	if (space == REMOTE_SPACE_EEPROM) {
+		return remote_eeprom_bits && !((address | len) & 1)
+			&& address + len <= (2UL << remote_eeprom_bits);
+	}
+	return space <= REMOTE_SPACE_FLASH && len <= 0x10000 - (uint16_t) address;
+}
+
+static uint8_t remote_read(uint8_t space, uint32_t address, uint16_t len) {
+	if (len > XMODEM_BLOCK_SIZE_MAX || !remote_range_valid(space, address, len)) {
+		return REMOTE_ERROR_ARGUMENT;
+	}
+	if (space == REMOTE_SPACE_EEPROM) {
+		xmb_offset = remote_eeprom_bits;
+		remote_reply(REMOTE_CMD_READ, REMOTE_OK, xmb_eeprom_read(address, len), len);
+	} else {
+		// the reply is sent straight from the window
+		outportb(IO_CART_FLASH, space == REMOTE_SPACE_FLASH ? 0x01 : 0x00);
+		remote_reply(REMOTE_CMD_READ, REMOTE_OK, remote_map(space, address), len);
+		outportb(IO_CART_FLASH, 0x00);
+	}
+	return REMOTE_OK;
+}
+
+static uint8_t remote_write(uint8_t space, uint32_t address, const uint8_t *data, uint16_t len) {
+	if (space == REMOTE_SPACE_ROM || !remote_range_valid(space, address, len)) {
+		return REMOTE_ERROR_ARGUMENT;
+	}
+	if (space == REMOTE_SPACE_EEPROM) {
+		xmb_offset = remote_eeprom_bits;
+		xmb_eeprom_write(address, data, len);
+		return REMOTE_OK;
+	}
+
+	uint8_t __far* dest = remote_map(space, address);
+	if (space == REMOTE_SPACE_SRAM) {
+		while (len--) {
+			*(dest++) = *(data++);
+		}
+		return REMOTE_OK;
+	}
+
+	bool result = true;
+	outportb(IO_CART_FLASH, 0x01);
+	for (uint16_t i = 0; i < len && result; i += 128) {
+		result = flash_write(data + i, FP_OFF(dest) + i, len - i < 128 ? len - i : 128, remote_flash_mode);
+	}
+	outportb(IO_CART_FLASH, 0x00);
+	return result ? REMOTE_OK : REMOTE_ERROR_FAILED;
+}
+
+// the whole bank, as xmf_erase() does it: boot sectors may be as small as 8 KB
+static uint8_t remote_erase(uint32_t address) {
+	bool result = true;
+	xmb_mode = remote_flash_mode;
+	remote_map(REMOTE_SPACE_FLASH, address);
+	outportb(IO_CART_FLASH, 0x01);
+	for (uint32_t region = 0; region < 0x10000 && result; region += XMF_ERASE_SIZE) {
+		result = xmf_erase_region((uint16_t) region);
+	}
+	outportb(IO_CART_FLASH, 0x00);
+	return result ? REMOTE_OK : REMOTE_ERROR_FAILED;
+}
+
+static uint8_t remote_crc(uint8_t space, uint32_t address, uint32_t len) {
+	uint16_t crc = 0;
+	if (space == REMOTE_SPACE_EEPROM) {
+		if (!remote_range_valid(space, address, len)) return REMOTE_ERROR_ARGUMENT;
+		xmb_offset = remote_eeprom_bits;
+		while (len) {
+			uint16_t chunk = len > XMODEM_BLOCK_SIZE_MAX ? XMODEM_BLOCK_SIZE_MAX : len;
+			crc = crc16(xmb_eeprom_read(address, chunk), chunk, crc);
+			address += chunk;
+			len -= chunk;
+		}
+	} else {
+		if (space > REMOTE_SPACE_FLASH) return REMOTE_ERROR_ARGUMENT;
+		outportb(IO_CART_FLASH, space == REMOTE_SPACE_FLASH ? 0x01 : 0x00);
+		// unlike reads, checksums may span banks
+		while (len) {
+			uint16_t chunk = 0x8000 - (address & 0x7FFF);
+			if (chunk > len) chunk = len;
+			crc = crc16(remote_map(space, address), chunk, crc);
+			address += chunk;
+			len -= chunk;
+		}
+		outportb(IO_CART_FLASH, 0x00);
+	}
+	uint8_t result[2] = {crc >> 8, crc};
+	remote_reply(REMOTE_CMD_CRC, REMOTE_OK, result, 2);
+	return REMOTE_OK;
+}
+
+// returns false once the host asks to leave remote mode
+static bool remote_execute(uint8_t cmd, uint16_t len) {
+	const uint8_t *p = remote_payload;
+	uint8_t status = REMOTE_ERROR_ARGUMENT;
+
+	switch (cmd) {
+	case REMOTE_CMD_IDENTIFY: {
+		uint8_t result[17];
+		const uint8_t __far* header = remote_map(REMOTE_SPACE_ROM, 0xFFFFFFF0);
+		result[0] = REMOTE_VERSION;
+		for (uint8_t i = 0; i < 16; i++) {
+			result[i + 1] = header[i];
+		}
+		remote_reply(cmd, REMOTE_OK, result, sizeof(result));
+		return true;
+	}
+	case REMOTE_CMD_READ:
+		if (len != 7) break;
+		status = remote_read(p[0], remote_get32(p + 1), remote_get16(p + 5));
+		if (status == REMOTE_OK) return true;
+		break;
+	case REMOTE_CMD_WRITE:
+		if (len < 5) break;
+		status = remote_write(p[0], remote_get32(p + 1), p + 5, len - 5);
+		break;
+	case REMOTE_CMD_ERASE:
+		if (len != 4) break;
+		status = remote_erase(remote_get32(p));
+		break;
+	case REMOTE_CMD_CRC:
+		if (len != 9) break;
+		status = remote_crc(p[0], remote_get32(p + 1), remote_get32(p + 5));
+		if (status == REMOTE_OK) return true;
+		break;
+	case REMOTE_CMD_CONFIG:
+		if (len != 2 || p[1] > FLASH_MODE_FAST_MX29L) break;
+		outportb(0xA0, (inportb(0xA0) & ~0x0C) | (p[0] & 0x0C));
+		remote_flash_mode = p[1];
+		status = REMOTE_OK;
+		break;
+	case REMOTE_CMD_BAUD:
+		if (len != 1 || p[0] >= XMODEM_RATE_COUNT) break;
+		remote_reply(cmd, REMOTE_OK, NULL, 0);
+		xmodem_set_rate(p[0]);
+		return true;
+	case REMOTE_CMD_EXIT:
+		remote_reply(cmd, REMOTE_OK, NULL, 0);
+		return false;
+	default:
+		status = REMOTE_ERROR_COMMAND;
+		break;
+	}
+	remote_reply(cmd, status, NULL, 0);
+	return true;
+}
+
+void menu_remote(void) {
+	ui_clear_lines(3, 17);
+	xmodem_status(msg_xmodem_init);
+	xmodem_open_default();
+	xmodem_status(msg_remote_active);
+	ui_puts_centered(8, COLOR_GRAY, msg_remote_exit);
+
+	bank_reset();
+	switch (*((uint8_t __far*) remote_map(REMOTE_SPACE_ROM, 0xFFFFFFFB))) {
+	case 0x10: remote_eeprom_bits = 6; break;
+	case 0x20:
+	case 0x50: remote_eeprom_bits = 10; break;
+	default: remote_eeprom_bits = 0; break;
+	}
+	remote_flash_mode = FLASH_MODE_SLOW;
+
+	uint16_t commands = 0, commands_drawn = 0xFFFF;
+	cpu_irq_disable();
+	while (true) {
+		uint16_t len;
+		uint8_t cmd = remote_recv(&len, TIMER_HZ / 8);
+		if (cmd != REMOTE_CMD_NONE) {
+			commands++;
+			if (!remote_execute(cmd, len)) break;
+		} else {
+			// the line is idle; a frame arriving meanwhile is resent by the host
+			if (ws_keypad_scan() & KEY_B) break;
+			if (commands != commands_drawn) {
+				commands_drawn = commands;
+				ui_clear_lines(10, 10);
+				ui_printf(8, 10, COLOR_WHITE, msg_remote_count, commands);
+			}
+		}
+	}
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	xmodem_close();
+	input_wait_clear();
+	ui_clear_lines(3, 17);
+}
+
+#ifdef PROFILE
+static const char msg_profile_header[] = "Section         Calls     ms";
+static const char msg_profile_row[] = "%-14s %6u %6lu";
+static const char msg_profile_keys[] = "A: send to host  B: reset";
+static const char msg_profile_sent[] = "Sent";
+
+void menu_profile(void) {
+menu_profile_init:
+	ui_clear_lines(3, 17);
+	ui_puts(0, 5, 0, msg_profile_header);
+	for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++) {
+		ui_printf(0, 6 + i, COLOR_WHITE, msg_profile_row, profile_section_names[i],
+			profile_sections[i].calls, profile_sections[i].ticks / (TIMER_HZ / 1000));
+	}
+	ui_puts_centered(13, COLOR_GRAY, msg_profile_keys);
+
+	input_wait_clear(); while (input_pressed == 0) { wait_for_vblank(); input_update(); }
+	if (input_pressed & KEY_A) {
+		xmodem_open_default();
+		profile_dump();
+		xmodem_close();
+		xmodem_status(msg_profile_sent);
+		wait_for_keypress();
+	} else if (input_pressed & KEY_B) {
+		profile_reset();
+		goto menu_profile_init;
+	}
+	input_wait_clear();
+	ui_clear_lines(3, 17);
+}
+#endif
+
 void menu_main(void) {
 	input_wait_clear();
 	uint16_t result = menu_show_main();
 	switch (result) {
 	case 0: // IPL transfer
 		if (check_transfer_ipl()) {
-			xmodem_run_send(xmb_ipl_read, 64, 1);
+			xmodem_run_send(xmb_ipl_read, 8192, 7);
 		}
 		break;
 	case 1: // Cart Backup
@@ -664,6 +1330,17 @@ void menu_main(void) {
 	case 4: // Cart Flash
 		menu_flash();
 		break;
+	case 5: // Link Test
+		menu_link_test();
+		break;
+	case 6: // Remote Control
+		menu_remote();
+		break;
+#ifdef PROFILE
+	case 7: // Profile
+		menu_profile();
+		break;
+#endif
 	default:
 		break;
 	}
@@ -676,6 +1353,7 @@ int main(void) {
 	xm_baudrate = 1;
 
 	ui_init();
+	timer_init();
 
 	outportb(IO_HWINT_ACK, 0xFF);
 	ws_hwint_set_handler(HWINT_IDX_VBLANK, vblank_int_handler);
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Fill words at segment:offset with value; 0x8000 words from offset 0
+ * covers a whole 64 KB segment.
+ */
+void mem_fill_words(uint16_t segment, uint16_t offset, uint16_t value, uint16_t words);
+
+/**
+ * Copy from segment:offset (ROM or internal RAM) to internal RAM using the
+ * WonderSwan Color general DMA. Addresses and length must be even.
+ */
+void mem_gdma_copy(void *dest, uint16_t segment, uint16_t offset, uint16_t len);
+
+/**
+ * Checksum words at segment:offset; position dependent, so swapped or
+ * shifted data changes it. words must be non-zero, 0x8000 covers 64 KB.
+ */
+uint32_t mem_checksum_words(uint16_t segment, uint16_t offset, uint16_t words);
+
+// Sum of the bytes in words at segment:offset; words must be non-zero.
+uint16_t mem_sum_bytes(uint16_t segment, uint16_t offset, uint16_t words);
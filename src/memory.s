@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <wonderful.h>
+
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+	.global mem_fill_words
+
+	.align 2
+mem_fill_words:
+	push	di
+	push	es
+	push	bp
+	mov	bp, sp
+
+	mov es, ax
+	mov di, dx
+	mov ax, cx
+	mov cx, [bp + IA16_CALL_STACK_OFFSET(6)]
+
+	cld
+	rep stosw
+
+	pop	bp
+	pop	es
+	pop	di
+
+	IA16_RET 0x2
+
+	// Copy from cartridge space to internal RAM using the general DMA.
+	// The CPU is halted for the duration of the transfer.
+	.global mem_gdma_copy
+	.align 2
+mem_gdma_copy:
+	push	bx
+	push	bp
+	mov	bp, sp
+
+	mov bx, ax
+
+	// linear source address = segment * 16 + offset
+	mov ax, dx
+	shl ax, 4
+	shr dx, 12
+	add ax, cx
+	adc dx, 0
+	out 0x40, ax
+	mov al, dl
+	out 0x42, al
+
+	mov ax, bx
+	out 0x44, ax
+	mov ax, [bp + IA16_CALL_STACK_OFFSET(4)]
+	out 0x46, ax
+
+	mov al, 0x80
+	out 0x48, al
+mem_gdma_copy_wait:
+	in al, 0x48
+	test al, 0x80
+	jnz mem_gdma_copy_wait
+
+	pop	bp
+	pop	bx
+
+	IA16_RET 0x2
+
+	// Fletcher-style checksum of words at segment:offset, with both sums
+	// kept modulo 65536. Returns (sum of running sums << 16) | sum of words.
+	.global mem_checksum_words
+	.align 2
+mem_checksum_words:
+	push	si
+	push	ds
+	push	bx
+
+	mov ds, ax
+	mov si, dx
+	xor bx, bx
+	xor dx, dx
+
+	cld
+	.balign 2, 0x90
+mem_checksum_words_loop:
+	lodsw
+	add bx, ax
+	add dx, bx
+	loop mem_checksum_words_loop
+
+	mov ax, bx
+
+	pop	bx
+	pop	ds
+	pop	si
+
+	IA16_RET
+
+	// Sum of the bytes in words at segment:offset, read a word at a time.
+	.global mem_sum_bytes
+	.align 2
+mem_sum_bytes:
+	push	si
+	push	ds
+	push	bx
+
+	mov ds, ax
+	mov si, dx
+	xor bx, bx
+	xor dx, dx
+
+	cld
+	.balign 2, 0x90
+mem_sum_bytes_loop:
+	lodsw
+	mov dl, ah
+	xor ah, ah
+	add bx, ax
+	add bx, dx
+	loop mem_sum_bytes_loop
+
+	mov ax, bx
+
+	pop	bx
+	pop	ds
+	pop	si
+
+	IA16_RET
@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wonderful.h>
+#include <ws.h>
+#include "bank.h"
+#include "flash.h"
+#include "patch.h"
+
+#define PATCH_STATE_HEADER 0
+#define PATCH_STATE_OFFSET 1
+#define PATCH_STATE_SIZE 2
+#define PATCH_STATE_RLE_SIZE 3
+#define PATCH_STATE_RLE_VALUE 4
+#define PATCH_STATE_DATA 5
+#define PATCH_STATE_DONE 6
+#define PATCH_STATE_ERROR 7
+
+#define PATCH_NO_BANK 0xFFFF
+// flash banks are mapped through the 2003 mapper's top 1024 banks
+#define PATCH_FLASH_BANK(bank) (0xFC00 | (bank))
+// erase commands are issued per 8 KB, the smallest sector of supported chips
+#define PATCH_ERASE_SIZE 0x2000
+#define PATCH_CHUNK_SIZE 128
+
+static const char patch_ips_magic[] = "PATCH";
+
+patch_status_t patch_status;
+
+static uint32_t patch_base;
+static uint32_t patch_size;
+static uint8_t patch_mode;
+static uint8_t patch_state;
+static uint8_t patch_count;
+static uint32_t patch_value;
+static uint32_t patch_offset;
+static uint16_t patch_left;
+static uint16_t patch_scratch;
+// flash_write reads from internal RAM
+static uint8_t patch_chunk[PATCH_CHUNK_SIZE];
+
+static const uint8_t __far* patch_map_rom(uint16_t bank) {
+	bank_set(BANK_ROM0, PATCH_FLASH_BANK(bank));
+	return MK_FP(0x2000, 0);
+}
+
+static void patch_map_flash(uint16_t bank) {
+	outportb(IO_CART_FLASH, 0x01);
+	bank_set(BANK_RAM, PATCH_FLASH_BANK(bank));
+}
+
+static uint8_t __far* patch_map_scratch(void) {
+	outportb(IO_CART_FLASH, 0x00);
+	// the last bank of SRAM
+	bank_set(BANK_RAM, 0xFFFF);
+	return MK_FP(0x1000, 0);
+}
+
+// smaller chips mirror within the bank; writes to them overwrite each other
+static bool patch_scratch_check(void) {
+	uint8_t __far* scratch = patch_map_scratch();
+	for (uint8_t i = 0; i < 8; i++) {
+		scratch[(uint16_t) i << 13] = i ^ 0x5A;
+	}
+	for (uint8_t i = 0; i < 8; i++) {
+		if (scratch[(uint16_t) i << 13] != (i ^ 0x5A)) return false;
+	}
+	return true;
+}
+
+static void patch_fail(uint8_t result) {
+	patch_status.result = result;
+	patch_state = PATCH_STATE_ERROR;
+}
+
+static void patch_load(uint16_t bank) {
+	const uint16_t __far* src = (const uint16_t __far*) patch_map_rom(bank);
+	uint16_t __far* dest = (uint16_t __far*) patch_map_scratch();
+	uint16_t words = 0x8000;
+	while (words--) {
+		*(dest++) = *(src++);
+	}
+	patch_scratch = bank;
+}
+
+static void patch_flush(void) {
+	if (patch_scratch == PATCH_NO_BANK) return;
+	uint16_t bank = patch_scratch;
+	patch_scratch = PATCH_NO_BANK;
+
+	// a sector erase clears its neighbours too; regions found blank are skipped
+	const uint8_t __far* rom = patch_map_rom(bank);
+	for (uint32_t region = 0; region < 0x10000; region += PATCH_ERASE_SIZE) {
+		const uint16_t __far* p = (const uint16_t __far*) (rom + (uint16_t) region);
+		for (uint16_t i = 0; i < (PATCH_ERASE_SIZE >> 1); i++) {
+			if (p[i] != 0xFFFF) {
+				patch_map_flash(bank);
+				if (!flash_erase((uint16_t) region, patch_mode)) {
+					patch_fail(PATCH_ERROR_FLASH);
+					return;
+				}
+				break;
+			}
+		}
+	}
+
+	for (uint32_t offset = 0; offset < 0x10000; offset += PATCH_CHUNK_SIZE) {
+		const uint8_t __far* src = patch_map_scratch() + (uint16_t) offset;
+		bool blank = true;
+		for (uint8_t i = 0; i < PATCH_CHUNK_SIZE; i++) {
+			patch_chunk[i] = src[i];
+			if (src[i] != 0xFF) blank = false;
+		}
+		if (blank) continue;
+		patch_map_flash(bank);
+		if (!flash_write(patch_chunk, (uint16_t) offset, PATCH_CHUNK_SIZE, patch_mode)) {
+			patch_fail(PATCH_ERROR_FLASH);
+			return;
+		}
+	}
+
+	// ROM0 still maps the bank; compare against SRAM
+	const uint16_t __far* src = (const uint16_t __far*) patch_map_scratch();
+	const uint16_t __far* dest = (const uint16_t __far*) rom;
+	for (uint16_t i = 0; i < 0x8000; i++) {
+		if (src[i] != dest[i]) {
+			patch_status.result = PATCH_ERROR_VERIFY;
+			break;
+		}
+	}
+	patch_status.banks_rewritten++;
+}
+
+// data stays within one bank and one chunk
+static void patch_apply_piece(uint32_t address, const uint8_t *data, uint16_t len) {
+	uint16_t bank = address >> 16;
+	uint16_t offset = address;
+
+	if (bank != patch_scratch) {
+		const uint8_t __far* rom = patch_map_rom(bank) + offset;
+		bool in_place = true, changed = false;
+		for (uint16_t i = 0; i < len; i++) {
+			if ((rom[i] & data[i]) != data[i]) in_place = false;
+			if (rom[i] != data[i]) changed = true;
+		}
+		if (!changed) return;
+		if (in_place) {
+			memcpy(patch_chunk, data, len);
+			patch_map_flash(bank);
+			bool written = flash_write(patch_chunk, offset, len, patch_mode);
+			outportb(IO_CART_FLASH, 0x00);
+			if (!written) {
+				patch_fail(PATCH_ERROR_FLASH);
+				return;
+			}
+			for (uint16_t i = 0; i < len; i++) {
+				if (rom[i] != data[i]) {
+					patch_status.result = PATCH_ERROR_VERIFY;
+					break;
+				}
+			}
+			patch_status.runs_in_place++;
+			return;
+		}
+		patch_flush();
+		if (patch_state == PATCH_STATE_ERROR) return;
+		patch_load(bank);
+	}
+
+	uint8_t __far* dest = patch_map_scratch() + offset;
+	while (len--) {
+		*(dest++) = *(data++);
+	}
+}
+
+static void patch_apply(uint32_t offset, const uint8_t *data, uint16_t len) {
+	if (offset + len > patch_size) {
+		patch_fail(PATCH_ERROR_RANGE);
+		return;
+	}
+	uint32_t address = patch_base + offset;
+	while (len && patch_state != PATCH_STATE_ERROR) {
+		uint16_t piece = PATCH_CHUNK_SIZE - (address & (PATCH_CHUNK_SIZE - 1));
+		if (piece > len) piece = len;
+		patch_apply_piece(address, data, piece);
+		address += piece;
+		data += piece;
+		len -= piece;
+	}
+}
+
+static void patch_apply_fill(uint32_t offset, uint8_t value, uint16_t len) {
+	uint8_t fill[PATCH_CHUNK_SIZE];
+	memset(fill, value, sizeof(fill));
+	while (len && patch_state != PATCH_STATE_ERROR) {
+		uint16_t piece = len > PATCH_CHUNK_SIZE ? PATCH_CHUNK_SIZE : len;
+		patch_apply(offset, fill, piece);
+		offset += piece;
+		len -= piece;
+	}
+}
+
+void patch_ips_init(uint16_t base_kbyte, uint32_t kbytes, uint8_t mode) {
+	patch_base = (uint32_t) base_kbyte << 10;
+	patch_size = kbytes << 10;
+	patch_mode = mode;
+	patch_state = PATCH_STATE_HEADER;
+	patch_count = 0;
+	patch_value = 0;
+	patch_scratch = PATCH_NO_BANK;
+	memset(&patch_status, 0, sizeof(patch_status));
+	if (!patch_scratch_check()) patch_fail(PATCH_ERROR_SRAM);
+}
+
+void patch_ips_write(uint32_t offset, const uint8_t *data, uint16_t len) {
+	while (len) {
+		switch (patch_state) {
+		case PATCH_STATE_DATA: {
+			uint16_t piece = len < patch_left ? len : patch_left;
+			patch_apply(patch_offset, data, piece);
+			if (patch_state == PATCH_STATE_ERROR) return;
+			patch_offset += piece;
+			patch_left -= piece;
+			data += piece;
+			len -= piece;
+			if (!patch_left) patch_state = PATCH_STATE_OFFSET;
+		} continue;
+		case PATCH_STATE_DONE:
+		case PATCH_STATE_ERROR:
+			// XMODEM padding, or the rest of a bad patch
+			return;
+		}
+
+		uint8_t v = *(data++);
+		len--;
+		patch_value = (patch_value << 8) | v;
+		patch_count++;
+
+		switch (patch_state) {
+		case PATCH_STATE_HEADER:
+			if (v != (uint8_t) patch_ips_magic[patch_count - 1]) {
+				patch_status.result = PATCH_ERROR_FORMAT;
+				patch_state = PATCH_STATE_ERROR;
+			} else if (patch_count == 5) {
+				patch_state = PATCH_STATE_OFFSET;
+				patch_count = 0;
+				patch_value = 0;
+			}
+			break;
+		case PATCH_STATE_OFFSET:
+			if (patch_count == 3) {
+				// "EOF"
+				patch_state = patch_value == 0x454F46 ? PATCH_STATE_DONE : PATCH_STATE_SIZE;
+				patch_offset = patch_value;
+				patch_count = 0;
+				patch_value = 0;
+			}
+			break;
+		case PATCH_STATE_SIZE:
+			if (patch_count == 2) {
+				patch_left = patch_value;
+				patch_state = patch_left ? PATCH_STATE_DATA : PATCH_STATE_RLE_SIZE;
+				patch_count = 0;
+				patch_value = 0;
+			}
+			break;
+		case PATCH_STATE_RLE_SIZE:
+			if (patch_count == 2) {
+				patch_left = patch_value;
+				patch_state = PATCH_STATE_RLE_VALUE;
+				patch_count = 0;
+				patch_value = 0;
+			}
+			break;
+		case PATCH_STATE_RLE_VALUE:
+			patch_apply_fill(patch_offset, v, patch_left);
+			if (patch_state == PATCH_STATE_ERROR) return;
+			patch_state = PATCH_STATE_OFFSET;
+			patch_count = 0;
+			patch_value = 0;
+			break;
+		}
+	}
+}
+
+uint8_t patch_ips_finish(void) {
+	if (patch_state == PATCH_STATE_DONE) {
+		patch_flush();
+	} else if (patch_state != PATCH_STATE_ERROR) {
+		// leave the pending bank as it was in flash
+		patch_status.result = PATCH_INCOMPLETE;
+	}
+	outportb(IO_CART_FLASH, 0x00);
+	return patch_status.result;
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * IPS patching of a flashed image, fed from an XMODEM transfer.
+ *
+ * Records are applied as they arrive. A record which only clears bits is
+ * programmed in place. Otherwise its 64 KB bank is copied to the last bank
+ * of cartridge SRAM, patched there, erased and reprogrammed once the patch
+ * moves on to another bank, which needs at least 64 KB of SRAM. SRAM
+ * contents are lost. A failed erase or program stops the patch.
+ */
+
+#define PATCH_OK 0
+#define PATCH_INCOMPLETE 1
+#define PATCH_ERROR_FORMAT 2
+#define PATCH_ERROR_RANGE 3
+#define PATCH_ERROR_VERIFY 4
+#define PATCH_ERROR_SRAM 5
+#define PATCH_ERROR_FLASH 6
+
+typedef struct {
+	uint16_t banks_rewritten;
+	uint16_t runs_in_place;
+	uint8_t result;
+} patch_status_t;
+
+extern patch_status_t patch_status;
+
+/**
+ * Start a patch of the image at base_kbyte (as programmed into the mapper,
+ * in kilobytes), kbytes long. Fails with PATCH_ERROR_SRAM in
+ * patch_status.result if SRAM cannot hold a bank.
+ */
+void patch_ips_init(uint16_t base_kbyte, uint32_t kbytes, uint8_t mode);
+// xmodem_block_writer for the patch file
+void patch_ips_write(uint32_t offset, const uint8_t *data, uint16_t len);
+// Program the last pending bank; returns PATCH_*.
+uint8_t patch_ips_finish(void);
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ws.h>
+#include "profile.h"
+
+#ifdef PROFILE
+
+profile_section_t profile_sections[PROFILE_SECTION_COUNT];
+
+static const char name_xmodem_write_block[] = "xmodem_write_block";
+static const char name_block_read[] = "xmb_*_read";
+static const char name_flash_write[] = "flash_write";
+static const char name_flash_erase[] = "flash_erase";
+static const char name_ui_printf[] = "ui_printf";
+
+const char* const profile_section_names[PROFILE_SECTION_COUNT] = {
+	name_xmodem_write_block,
+	name_block_read,
+	name_flash_write,
+	name_flash_erase,
+	name_ui_printf
+};
+
+static const char msg_profile_record[] = "WSBT-PROFILE section=%s calls=%u ticks=%lu hz=%u\r\n";
+
+void profile_reset(void) {
+	memset(profile_sections, 0, sizeof(profile_sections));
+}
+
+void profile_dump(void) {
+	char buf[80];
+
+	for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++) {
+		uint16_t len = snprintf(buf, sizeof(buf), msg_profile_record,
+			profile_section_names[i], profile_sections[i].calls, profile_sections[i].ticks, TIMER_HZ);
+		if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+		for (uint16_t j = 0; j < len; j++) {
+			ws_serial_putc(buf[j]);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "timer.h"
+
+#define PROFILE_XMODEM_WRITE_BLOCK 0
+#define PROFILE_BLOCK_READ 1
+#define PROFILE_FLASH_WRITE 2
+#define PROFILE_FLASH_ERASE 3
+#define PROFILE_UI_PRINTF 4
+#define PROFILE_SECTION_COUNT 5
+
+#ifdef PROFILE
+
+typedef struct {
+	uint32_t ticks;
+	uint32_t start;
+	uint16_t calls;
+} profile_section_t;
+
+extern profile_section_t profile_sections[PROFILE_SECTION_COUNT];
+extern const char* const profile_section_names[PROFILE_SECTION_COUNT];
+
+void profile_reset(void);
+/**
+ * Write one "WSBT-PROFILE" text line per section to the serial port,
+ * which must already be open.
+ */
+void profile_dump(void);
+
+static inline void profile_begin(uint8_t section) {
+	profile_sections[section].start = timer_ticks();
+}
+
+static inline void profile_end(uint8_t section) {
+	profile_section_t *s = &profile_sections[section];
+	s->ticks += timer_ticks() - s->start;
+	s->calls++;
+}
+
+#define PROFILE_BEGIN(section) profile_begin(section)
+#define PROFILE_END(section) profile_end(section)
+
+#else
+
+// compiled out unless built with PROFILE=1
+#define PROFILE_BEGIN(section)
+#define PROFILE_END(section)
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#include <ws.h>
+#include "crc16.h"
+#include "remote.h"
+#include "timer.h"
+#include "xmodem.h"
+#include "xmodem_io.h"
+
+uint8_t remote_payload[REMOTE_PAYLOAD_MAX];
+
+uint8_t remote_recv(uint16_t *len, uint16_t ticks) {
+	uint8_t header[3];
+	int16_t r;
+
+	if ((r = xmodem_getc_timeout(ticks)) != REMOTE_SYNC_REQUEST) {
+		return REMOTE_CMD_NONE;
+	}
+	for (uint8_t i = 0; i < 3; i++) {
+		if ((r = xmodem_getc_timeout(TIMER_HZ / 4)) < 0) return REMOTE_CMD_NONE;
+		header[i] = r;
+	}
+	*len = remote_get16(header + 1);
+	if (*len > REMOTE_PAYLOAD_MAX) {
+		// not a frame we could have sent; resynchronize
+		return REMOTE_CMD_NONE;
+	}
+
+	uint16_t crc;
+	if (xmodem_io_read_crc(remote_payload, *len, &crc) != *len) {
+		return REMOTE_CMD_NONE;
+	}
+	crc = crc16(header, 3, crc);
+	for (uint8_t i = 0; i < 2; i++) {
+		if ((r = xmodem_getc_timeout(TIMER_HZ / 4)) < 0) return REMOTE_CMD_NONE;
+		crc ^= r << (i ? 0 : 8);
+	}
+	if (crc) {
+		remote_reply(header[0], REMOTE_ERROR_CRC, NULL, 0);
+		return REMOTE_CMD_NONE;
+	}
+	return header[0];
+}
+
+void remote_reply(uint8_t cmd, uint8_t status, const uint8_t __far* data, uint16_t len) {
+	uint8_t header[4] = {cmd, status, len, len >> 8};
+
+	ws_serial_putc(REMOTE_SYNC_REPLY);
+	for (uint8_t i = 0; i < 4; i++) {
+		ws_serial_putc(header[i]);
+	}
+	uint16_t crc = len ? xmodem_io_write_crc(data, len) : 0;
+	crc = crc16(header, 4, crc);
+	ws_serial_putc(crc >> 8);
+	ws_serial_putc(crc);
+}
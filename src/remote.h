@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#include "xmodem.h"
+
+/**
+ * Remote control protocol.
+ *
+ * The host sends request frames; the device executes them in order and
+ * answers every frame it could parse with exactly one reply frame.
+ *
+ * Request: 0xA5, command, length (16-bit LE), payload, CRC-16 (BE)
+ * Reply:   0x5A, command, status, length (16-bit LE), payload, CRC-16 (BE)
+ *
+ * The CRC-16 (XMODEM polynomial, initial value 0) is computed over the
+ * payload first, then over the header bytes after the sync byte. A host
+ * which gets no reply within one second should resend the request; frames
+ * lost while the device updates the screen are expected.
+ *
+ * Addresses are 32-bit little-endian: the top 16 bits are the bank as
+ * written to the cartridge mapper, the bottom 16 bits the offset in it.
+ * EEPROM addresses are byte offsets. A read or write may not cross a
+ * 64 KB bank.
+ */
+
+#define REMOTE_SYNC_REQUEST 0xA5
+#define REMOTE_SYNC_REPLY 0x5A
+
+#define REMOTE_VERSION 1
+
+#define REMOTE_CMD_NONE 0x00
+// -> version, ROM header (16 bytes)
+#define REMOTE_CMD_IDENTIFY 0x01
+// space, address (4), length (2) -> data
+#define REMOTE_CMD_READ 0x02
+// space, address (4), data ->
+#define REMOTE_CMD_WRITE 0x03
+// address (4) -> ; erases every sector of the 64 KB bank holding address
+// that is not already blank, which can take several seconds
+#define REMOTE_CMD_ERASE 0x04
+// space, address (4), length (4) -> CRC-16 (BE)
+#define REMOTE_CMD_CRC 0x05
+// port 0xA0 wait state/access width bits, flash mode ->
+#define REMOTE_CMD_CONFIG 0x06
+// rate (XMODEM_RATE_*) -> ; the reply is sent at the old rate
+#define REMOTE_CMD_BAUD 0x07
+#define REMOTE_CMD_EXIT 0x08
+
+#define REMOTE_SPACE_ROM 0
+#define REMOTE_SPACE_SRAM 1
+#define REMOTE_SPACE_EEPROM 2
+#define REMOTE_SPACE_FLASH 3
+
+#define REMOTE_OK 0
+#define REMOTE_ERROR_CRC 1
+#define REMOTE_ERROR_COMMAND 2
+#define REMOTE_ERROR_ARGUMENT 3
+#define REMOTE_ERROR_FAILED 4
+
+// a write header followed by the largest XMODEM block
+#define REMOTE_PAYLOAD_MAX (XMODEM_BLOCK_SIZE_MAX + 5)
+
+extern uint8_t remote_payload[REMOTE_PAYLOAD_MAX];
+
+/**
+ * Wait up to ticks for a request. Returns its command, with the payload in
+ * remote_payload, or REMOTE_CMD_NONE. Damaged frames are answered with
+ * REMOTE_ERROR_CRC here.
+ */
+uint8_t remote_recv(uint16_t *len, uint16_t ticks);
+void remote_reply(uint8_t cmd, uint8_t status, const uint8_t __far* data, uint16_t len);
+
+static inline uint16_t remote_get16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t remote_get32(const uint8_t *p) {
+	return remote_get16(p) | ((uint32_t) remote_get16(p + 2) << 16);
+}
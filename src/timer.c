@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <ws.h>
+#include "timer.h"
+
+static uint16_t timer_last;
+static uint32_t timer_total;
+
+void timer_init(void) {
+	// free-running HBlank timer: reload 0xFFFF, auto-repeat
+	outportw(0xA4, 0xFFFF);
+	outportb(0xA2, (inportb(0xA2) & 0xFC) | 0x03);
+	timer_last = inportw(0xA8);
+	timer_total = 0;
+}
+
+uint32_t timer_ticks(void) {
+	// the counter counts down
+	uint16_t now = inportw(0xA8);
+	timer_total += (uint16_t) (timer_last - now);
+	timer_last = now;
+	return timer_total;
+}
@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// HBlank timer ticks per second (one tick per scanline)
+#define TIMER_HZ 12000
+
+void timer_init(void);
+/**
+ * Returns a monotonic tick count. The underlying 16-bit counter wraps
+ * every ~5 seconds, so this must be called at least that often while
+ * measuring an interval.
+ */
+uint32_t timer_ticks(void);
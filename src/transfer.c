@@ -0,0 +1,293 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wonderful.h>
+#include <ws.h>
+#include "profile.h"
+#include "timer.h"
+#include "transfer.h"
+#include "ui.h"
+#include "xmodem.h"
+
+volatile uint8_t xm_baudrate;
+
+void xmodem_open_default(void) {
+	if (xm_baudrate == XMODEM_RATE_AUTO)
+		xmodem_open_auto();
+	else
+		xmodem_open(xm_baudrate);
+}
+
+const char msg_xmodem_init[] = "Initializing XMODEM transfer";
+static const char msg_xmodem_progress[] = "Transferring data";
+const char msg_erase_progress[] = "Erasing data";
+static const char msg_xmodem_transfer_error[] = "Transfer error";
+static const char msg_xmodem_blocks_full[] = "0000/%04d";
+// kilobyte ranges of large ROMs
+static const char msg_xmodem_blocks_wide[] = "00000/%05u";
+static const char msg_xmodem_stats_rate[] = "%lu B/s  NAK %u  TO %u";
+static const char msg_xmodem_stats_split[] = "Wait %u%%  I/O %u%%  Flash %u%%";
+
+void xmodem_status(const char *str) {
+	ui_clear_lines(6, 6);
+	ui_puts_centered(6, COLOR_BLACK, str);
+}
+
+uint8_t xmb_buffer[XMODEM_BLOCK_SIZE_MAX];
+
+static void xmodem_update_counter(uint8_t x, uint8_t y, uint16_t value) {
+	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 3, y); value /= 10; if (value == 0) return;
+	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 2, y); value /= 10; if (value == 0) return;
+	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x + 1, y); value /= 10; if (value == 0) return;
+	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x,     y); value /= 10; if (value == 0) return;
+	ws_screen_put_tile(SCREEN1, (value % 10) + ((uint8_t)'0' | SCR_ENTRY_PALETTE(COLOR_WHITE)), x - 1, y);
+}
+
+// progress is shown per unit (bank, kilobyte, ...) and per 128 bytes within it;
+// transfer loops only store the offset, vblank_progress_update() draws it
+static uint8_t xm_unit_shift;
+static uint16_t xm_blocks, xm_subblocks;
+static uint16_t xm_block_mask, xm_subblock_mask;
+static uint16_t xm_block_tiles, xm_subblock_tiles;
+static uint16_t xm_block_last;
+static uint32_t xm_drawn_offset;
+
+volatile xmodem_progress_t xm_progress;
+
+void xmodem_progress_init(uint32_t size, uint8_t unit_shift) {
+	xm_progress.active = false;
+	xm_unit_shift = unit_shift;
+	xm_blocks = size >> unit_shift;
+	xm_subblocks = 1 << (unit_shift - 7);
+	xm_block_mask = (xm_blocks >> 4); if(xm_block_mask < 1) xm_block_mask = 1;
+	xm_subblock_mask = (xm_subblocks >> 4); if(xm_subblock_mask < 1) xm_subblock_mask = 1;
+	xm_block_tiles = 0;
+	xm_block_last = 0xFFFF;
+	xm_drawn_offset = 0xFFFFFFFF;
+
+	ui_clear_lines(11, 11);
+	if (xm_blocks > 9999) {
+		ui_printf(17, 11, COLOR_WHITE, msg_xmodem_blocks_wide, xm_blocks);
+	} else {
+		ui_printf(18, 11, COLOR_WHITE, msg_xmodem_blocks_full, xm_blocks);
+	}
+
+	xm_progress.offset = 0;
+	xm_progress.stats_dirty = false;
+	xm_progress.active = true;
+}
+
+/**
+ * Transfers run with interrupts disabled, as the serial port has no FIFO.
+ * Between blocks the line is idle, so let a pending VBlank interrupt in.
+ */
+static inline void xmodem_irq_window(void) {
+	cpu_irq_enable();
+	// STI only takes effect after the next instruction
+	__asm volatile ("nop");
+	cpu_irq_disable();
+}
+
+static void xmodem_progress_draw(uint32_t offset) {
+	if (offset == xm_drawn_offset) return;
+	xm_drawn_offset = offset;
+
+	uint16_t ib = offset >> xm_unit_shift;
+	uint16_t isb = (offset >> 7) & (xm_subblocks - 1);
+
+	if (ib != xm_block_last) {
+		xm_block_last = ib;
+		while (xm_block_tiles <= (ib / xm_block_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_RED) | 0x0A, 1 + (xm_block_tiles++), 11);
+		xmodem_update_counter(18, 11, ib+1);
+		if(xm_subblocks > 1) {
+			ui_clear_lines(12, 12);
+			ui_printf(18, 12, COLOR_WHITE, msg_xmodem_blocks_full, xm_subblocks);
+			xm_subblock_tiles = 0;
+		}
+	}
+	if(xm_subblocks > 1) {
+		xmodem_update_counter(18, 12, isb+1);
+		while (xm_subblock_tiles <= (isb / xm_subblock_mask)) ws_screen_put_tile(SCREEN1, SCR_ENTRY_PALETTE(COLOR_YELLOW) | 0x0A, 1 + (xm_subblock_tiles++), 12);
+	}
+}
+
+static uint32_t xm_stats_last;
+static bool xm_stats_erased;
+
+static uint16_t xmodem_stats_percent(uint32_t ticks) {
+	return xmodem_stats.ticks >= 100 ? ticks / (xmodem_stats.ticks / 100) : 0;
+}
+
+// where the time goes: waiting on the link, moving bytes, or programming flash
+static void xmodem_stats_draw(void) {
+	ui_clear_lines(14, 15);
+	ui_printf(1, 14, COLOR_GRAY, msg_xmodem_stats_rate,
+		xmodem_stats_bytes_per_second(), xmodem_stats.naks, xmodem_stats.timeouts);
+	ui_printf(1, 15, COLOR_GRAY, msg_xmodem_stats_split,
+		xmodem_stats_percent(xmodem_stats.wait_ticks),
+		xmodem_stats_percent(xmodem_stats.io_ticks),
+		xmodem_stats_percent(xmodem_stats.flash_program_ticks + xmodem_stats.flash_erase_ticks));
+}
+
+static void xmodem_stats_tick(void) {
+	xmodem_stats_update();
+	if ((xmodem_stats.ticks - xm_stats_last) >= (TIMER_HZ / 2)) {
+		xm_stats_last = xmodem_stats.ticks;
+		xm_progress.stats_dirty = true;
+	}
+}
+
+static void xmodem_stats_begin(void) {
+	xmodem_stats_reset();
+	xm_stats_last = 0;
+}
+
+// called from vblank_int_handler
+void vblank_progress_update(void) {
+	if (!xm_progress.active) return;
+	xmodem_progress_draw(xm_progress.offset);
+	if (xm_progress.stats_dirty) {
+		xm_progress.stats_dirty = false;
+		xmodem_stats_draw();
+	}
+}
+
+void xmodem_run_send(xmodem_block_reader reader, uint32_t size, uint8_t unit_shift) {
+	xmodem_status(msg_xmodem_init);
+	xmodem_open_default();
+
+	if (xmodem_send_start() == XMODEM_OK) {
+		cpu_irq_disable();
+		xmodem_status(msg_xmodem_progress);
+		xmodem_progress_init(size, unit_shift);
+		xmodem_stats_begin();
+		uint32_t offset = 0;
+		while (offset < size) {
+			xmodem_progress_update(offset);
+			xmodem_stats_tick();
+			xmodem_irq_window();
+
+			// larger blocks must stay aligned and within the transfer
+			uint16_t len = xmodem_send_block_size();
+			if ((offset & (len - 1)) || (size - offset) < len) len = XMODEM_BLOCK_SIZE;
+
+			PROFILE_BEGIN(PROFILE_BLOCK_READ);
+			const uint8_t __far* block = reader(offset, len);
+			PROFILE_END(PROFILE_BLOCK_READ);
+
+			uint8_t result = xmodem_send_block(block, len);
+			switch (result) {
+			case XMODEM_OK:
+				break;
+			case XMODEM_ERROR:
+				xmodem_progress_end();
+				xmodem_status(msg_xmodem_transfer_error);
+				ws_hwint_ack(0xFF);
+				cpu_irq_enable();
+				wait_for_keypress();
+			case XMODEM_SELF_CANCEL:
+			case XMODEM_CANCEL:
+				goto End;
+			}
+			offset += len;
+		}
+		xmodem_send_finish();
+		xmodem_stats_send();
+	}
+End:
+	xmodem_progress_end();
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	xmodem_close();
+	ui_clear_lines(3, 17);
+}
+
+void xmodem_run_recv(xmodem_block_writer writer, uint32_t size, uint8_t unit_shift, bool erase) {
+	if(!erase) {
+		xmodem_status(msg_xmodem_init);
+		xmodem_open_default();
+	}
+
+	cpu_irq_disable();
+	{
+		xmodem_status(erase ? msg_erase_progress : msg_xmodem_progress);
+		xmodem_progress_init(size, unit_shift);
+		// an erase pass and the transfer after it are reported as one session
+		if(erase || !xm_stats_erased) {
+			xmodem_stats_begin();
+		}
+		xm_stats_erased = erase;
+		if(!erase) {
+			xmodem_recv_start();
+		}
+		uint32_t offset = 0;
+		while (offset < size) {
+			xmodem_progress_update(offset);
+			xmodem_stats_tick();
+			xmodem_irq_window();
+
+			uint16_t len = XMODEM_BLOCK_SIZE;
+			if(erase) {
+				memset(xmb_buffer, 0xFF, len);
+			} else {
+				uint8_t result = xmodem_recv_block(xmb_buffer, &len);
+				switch (result) {
+				case XMODEM_OK:
+					break;
+				case XMODEM_ERROR:
+					xmodem_progress_end();
+					xmodem_status(msg_xmodem_transfer_error);
+					ws_hwint_ack(0xFF);
+					cpu_irq_enable();
+					wait_for_keypress();
+				case XMODEM_SELF_CANCEL:
+				case XMODEM_CANCEL:
+					goto End;
+				case XMODEM_COMPLETE:
+					goto Complete;
+				}
+				// drop the padding of the final block
+				if (len > size - offset) len = size - offset;
+			}
+			for (uint16_t i = 0; i < len;) {
+				uint16_t piece = 0x400 - ((offset + i) & 0x3FF);
+				if (piece > len - i) piece = len - i;
+				writer(offset + i, xmb_buffer + i, piece);
+				i += piece;
+			}
+			offset += len;
+		}
+		if(!erase) {
+			// acknowledge the final block, then wait for the end of transmission
+			uint16_t len;
+			while (xmodem_recv_block(NULL, &len) == XMODEM_OK);
+		}
+	}
+Complete:
+	if(!erase) {
+		xmodem_stats_send();
+	}
+End:
+	xmodem_progress_end();
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	if(!erase) xmodem_close();
+	ui_clear_lines(3, 17);
+}
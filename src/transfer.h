@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wonderful.h>
+#include "xmodem.h"
+
+// XMODEM_RATE_*, including XMODEM_RATE_AUTO
+extern volatile uint8_t xm_baudrate;
+
+extern const char msg_xmodem_init[];
+extern const char msg_erase_progress[];
+
+typedef const uint8_t __far* (*xmodem_block_reader)(uint32_t offset, uint16_t len);
+// len never crosses a 1 KB boundary; data always points into xmb_buffer
+typedef void (*xmodem_block_writer)(uint32_t offset, const uint8_t *data, uint16_t len);
+
+extern uint8_t xmb_buffer[XMODEM_BLOCK_SIZE_MAX];
+
+void xmodem_open_default(void);
+void xmodem_status(const char *str);
+
+// shared with the VBlank handler, which draws it
+typedef struct {
+	uint32_t offset;
+	bool active;
+	bool stats_dirty;
+} xmodem_progress_t;
+
+extern volatile xmodem_progress_t xm_progress;
+
+// progress is shown per unit (1 << unit_shift bytes) and per 128 bytes within it
+void xmodem_progress_init(uint32_t size, uint8_t unit_shift);
+
+static inline void xmodem_progress_update(uint32_t offset) {
+	xm_progress.offset = offset;
+}
+
+static inline void xmodem_progress_end(void) {
+	xm_progress.active = false;
+}
+
+void vblank_progress_update(void);
+
+void xmodem_run_send(xmodem_block_reader reader, uint32_t size, uint8_t unit_shift);
+/**
+ * Receive size bytes into writer. With erase set, no transfer takes place;
+ * writer is called with 0xFF bytes over the whole range instead.
+ */
+void xmodem_run_recv(xmodem_block_writer writer, uint32_t size, uint8_t unit_shift, bool erase);
@@ -22,6 +22,7 @@
 #include <wsx/zx0.h>
 #include "font_default.h"
 #include "input.h"
+#include "profile.h"
 #include "ui.h"
 #include "util.h"
 
@@ -69,12 +70,18 @@ NewLine:
 
 void ui_printf(uint8_t x, uint8_t y, uint8_t color, const char __far* format, ...) {
     char buf[128];
+    PROFILE_BEGIN(PROFILE_UI_PRINTF);
     va_list val;
     va_start(val, format);
     vsnprintf(buf, sizeof(buf), format, val);
     va_end(val);
 
     ui_puts(x, y, color, buf);
+    PROFILE_END(PROFILE_UI_PRINTF);
+}
+
+void wait_for_keypress(void) {
+    input_wait_clear(); while (input_pressed == 0) { wait_for_vblank(); input_update(); } input_wait_clear();
 }
 
 void ui_init(void) {
@@ -38,6 +38,7 @@ static inline void ui_puts_centered(uint8_t y, uint8_t color, const char __far*
     ui_puts((28 - strlen(buf)) >> 1, y, color, buf);
 }
 void ui_printf(uint8_t x, uint8_t y, uint8_t color, const char __far* format, ...);
+void wait_for_keypress(void);
 
 #define MENU_ENTRY_DISABLED 0x0001
 #define MENU_ENTRY_ADJUSTABLE 0x0002
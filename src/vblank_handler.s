@@ -25,16 +25,22 @@
 vblank_int_handler:
 	pusha
 	push ds
+	// compiled C treats ES as scratch, and its string ops expect ES = DS
+	push es
 	push ss
 	pop ds
+	push ss
+	pop es
 
 	inc word ptr [vbl_ticks]
 	call vblank_input_update
+	call vblank_progress_update
 
 	// Acknowledge interrupt
 	mov al, 0x40
 	out 0xB6, al
 
+	pop es
 	pop ds
 	popa
 	iret
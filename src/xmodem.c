@@ -22,86 +22,388 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <wonderful.h>
+#include <ws.h>
+#include "crc16.h"
 #include "input.h"
+#include "profile.h"
+#include "timer.h"
 #include "ui.h"
 #include "util.h"
 #include "xmodem.h"
+#include "xmodem_io.h"
 
 #define SOH 1
+#define STX 2
 #define EOT 4
 #define ACK 6
 #define NAK 21
 #define CAN 24
+#define CRC 'C'
+
+// internal: the previous block was sent again, as our ACK got lost
+#define XMODEM_DUPLICATE 0x80
+
+// retries of a single block before stepping the rate down
+#define XMODEM_AUTO_RETRIES 3
+// clean blocks before trying the next rate up; doubles after each step down
+#define XMODEM_AUTO_CLEAN_BLOCKS 64
+// longer than the host's one second of silence before it steps down
+#define XMODEM_AUTO_TIMEOUT_TICKS (TIMER_HZ * 2)
+// clean 128-byte blocks before switching to 1024-byte blocks
+#define XMODEM_GROW_BLOCKS 4
+// receiver: interval between start requests, and how many to send as 'C'
+#define XMODEM_START_TIMEOUT_TICKS (TIMER_HZ * 3)
+#define XMODEM_START_CRC_TRIES 3
 
 static uint8_t xmodem_idx;
 static uint8_t xmodem_retry;
+static bool xmodem_crc;
+static uint8_t xmodem_start_tries;
+static uint16_t xmodem_block_size;
+static uint8_t xmodem_grow_blocks;
+static void (*xmodem_idle_hook)(void);
+
+static uint8_t xmodem_rate;
+static uint8_t xmodem_rate_max;
+static bool xmodem_auto;
+static uint16_t xmodem_clean_blocks;
+static uint16_t xmodem_clean_target;
+
+xmodem_stats_t xmodem_stats;
+static uint32_t xmodem_stats_start;
+
+static const uint8_t xmodem_probe_data[] = {
+	XMODEM_ESC, XMODEM_ESC_PROBE,
+	0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC,
+	0x01, 0x80, 0x7F, 0xFE, 0x11, 0xEE, 0x5A, 0xA5
+};
+
+void xmodem_stats_reset(void) {
+	memset(&xmodem_stats, 0, sizeof(xmodem_stats));
+	xmodem_stats_start = timer_ticks();
+}
+
+void xmodem_stats_update(void) {
+	xmodem_stats.ticks = timer_ticks() - xmodem_stats_start;
+}
+
+uint32_t xmodem_stats_bytes_per_second(void) {
+	uint32_t bytes = xmodem_stats.bytes;
+	uint32_t ticks = xmodem_stats.ticks;
+	// keep bytes * TIMER_HZ within 32 bits
+	while (bytes > (0xFFFFFFFFUL / TIMER_HZ)) {
+		bytes >>= 1;
+		ticks >>= 1;
+	}
+	return ticks ? (bytes * TIMER_HZ / ticks) : 0;
+}
+
+static const char msg_stats_record[] = "\r\nWSBT-STATS bytes=%" PRIu32 " ticks=%" PRIu32 " hz=%u bps=%" PRIu32
+	" blocks=%u naks=%u retries=%u timeouts=%u rate=%u rate_changes=%u"
+	" wait=%" PRIu32 " io=%" PRIu32 " flash_program=%" PRIu32 " flash_erase=%" PRIu32 "\r\n";
+
+void xmodem_stats_send(void) {
+	char buf[200];
+
+	xmodem_stats_update();
+	uint16_t len = snprintf(buf, sizeof(buf), msg_stats_record,
+		xmodem_stats.bytes, xmodem_stats.ticks, TIMER_HZ, xmodem_stats_bytes_per_second(),
+		xmodem_stats.blocks, xmodem_stats.naks, xmodem_stats.retries, xmodem_stats.timeouts,
+		xmodem_rate, xmodem_stats.rate_changes,
+		xmodem_stats.wait_ticks, xmodem_stats.io_ticks,
+		xmodem_stats.flash_program_ticks, xmodem_stats.flash_erase_ticks);
+	if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+	for (uint16_t i = 0; i < len; i++) {
+		ws_serial_putc(buf[i]);
+	}
+}
 
 bool xmodem_poll_exit(void) {
 	return false;
 }
 
-void xmodem_open(uint8_t baudrate) {
-	ws_serial_open(baudrate);
+static void xmodem_serial_open(uint8_t rate) {
+	xmodem_rate = rate;
+	// 192000 bps is the 38400 bps divisor with the fast clock bit set
+	outportb(0xA3, rate == XMODEM_RATE_192000 ? 0x08 : 0x00);
+	ws_serial_open(rate == XMODEM_RATE_9600 ? SERIAL_BAUD_9600 : SERIAL_BAUD_38400);
+}
+
+void xmodem_open(uint8_t rate) {
+	xmodem_auto = false;
+	xmodem_serial_open(rate);
 	ws_hwint_set_default_handler_serial_rx();
 }
 
+static void xmodem_drain(void) {
+	// wait for the transmit buffer, then for the shift register
+	while (!(inportb(0xB3) & 0x04));
+	uint32_t start = timer_ticks();
+	while ((timer_ticks() - start) < 16);
+}
+
+void xmodem_set_rate(uint8_t rate) {
+	xmodem_drain();
+	ws_serial_close();
+	xmodem_serial_open(rate);
+}
+
 void xmodem_close(void) {
 	ws_serial_close();
 }
 
-// call after SOH
-static uint8_t xmodem_read_block(uint8_t __far* block) {
-	uint8_t idx = ws_serial_getc();
-	if (idx != xmodem_idx) {
-		return XMODEM_CANCEL;
+int16_t xmodem_getc_timeout(uint16_t ticks) {
+	uint32_t start = timer_ticks();
+	do {
+		int16_t r = ws_serial_getc_nonblock();
+		if (r >= 0) return r;
+	} while ((timer_ticks() - start) < ticks);
+	return -1;
+}
+
+void xmodem_flush(void) {
+	while (ws_serial_getc_nonblock() >= 0);
+}
+
+// send data while collecting its echo from the host
+uint8_t xmodem_echo(const uint8_t __far* data, uint16_t len) {
+	uint16_t sent = 0, received = 0;
+	bool match = true;
+	int16_t r;
+
+	while (sent < len) {
+		ws_serial_putc(data[sent++]);
+		// drain as we go - a loopback plug echoes while we are still sending
+		while ((r = ws_serial_getc_nonblock()) >= 0) {
+			if (received >= len || r != data[received]) match = false;
+			received++;
+		}
 	}
-	uint8_t idx_inv = ws_serial_getc();
-	if ((idx ^ 0xFF) != idx_inv) {
-		return XMODEM_CANCEL;
+	while (received < len) {
+		if ((r = xmodem_getc_timeout(TIMER_HZ / 4)) < 0) {
+			return XMODEM_TIMEOUT;
+		}
+		if (r != data[received]) match = false;
+		received++;
+	}
+	return match ? XMODEM_OK : XMODEM_ERROR;
+}
+
+// returns true if the host echoed the request; the rate is switched either way
+bool xmodem_request_rate(uint8_t rate) {
+	uint8_t req[4] = {XMODEM_ESC, XMODEM_ESC_RATE, rate, rate ^ 0xFF};
+
+	xmodem_flush();
+	bool echoed = xmodem_echo(req, sizeof(req)) == XMODEM_OK;
+	xmodem_set_rate(rate);
+	return echoed;
+}
+
+bool xmodem_query_sizes(const uint8_t __far* header, xmodem_cart_sizes_t *sizes) {
+	uint8_t req[20];
+	uint8_t reply[8];
+	uint8_t received = 0;
+	bool result = false;
+	int16_t r;
+
+	req[0] = XMODEM_ESC;
+	req[1] = XMODEM_ESC_HEADER;
+	for (uint8_t i = 0; i < 16; i++) {
+		req[i + 2] = header[i];
+	}
+	uint16_t crc = crc16(req + 2, 16, 0);
+	req[18] = crc >> 8;
+	req[19] = crc;
+
+	xmodem_open(XMODEM_RATE_9600);
+	cpu_irq_disable();
+	xmodem_flush();
+	for (uint8_t i = 0; i < sizeof(req); i++) {
+		ws_serial_putc(req[i]);
 	}
 
-	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
-		uint8_t v = ws_serial_getc();
-		checksum += v;
-		if (block != NULL) { 
-			block[i] = v;
+	// skip whatever the host sent before its answer, such as 'C' polls
+	uint32_t start = timer_ticks();
+	while ((r = xmodem_getc_timeout(TIMER_HZ / 4)) >= 0 && r != XMODEM_ESC) {
+		if ((timer_ticks() - start) >= TIMER_HZ / 2) {
+			r = -1;
+			break;
 		}
 	}
+	if (r >= 0 && xmodem_getc_timeout(TIMER_HZ / 4) == XMODEM_ESC_HEADER) {
+		while (received < sizeof(reply) && (r = xmodem_getc_timeout(TIMER_HZ / 4)) >= 0) {
+			reply[received++] = r;
+		}
+	}
+	if (received == sizeof(reply) && crc16(reply, 6, 0) == ((reply[6] << 8) | reply[7])) {
+		sizes->rom_banks = reply[0] | (reply[1] << 8);
+		sizes->sram_kbytes = reply[2] | (reply[3] << 8);
+		sizes->eeprom_bytes = reply[4] | (reply[5] << 8);
+		// every known cartridge has a ROM
+		result = sizes->rom_banks != 0 && sizes->rom_banks <= 1024 && sizes->eeprom_bytes <= 2048;
+	}
 
-	uint8_t checksum_actual = ws_serial_getc();
-	return (checksum == checksum_actual) ? XMODEM_OK : XMODEM_ERROR;
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	xmodem_close();
+	return result;
 }
 
-static void xmodem_write_block(const uint8_t __far* block) {
-	ws_serial_putc(SOH);
+// wait for the line to go quiet before asking for a resend
+static void xmodem_purge(void) {
+	while (xmodem_getc_timeout(TIMER_HZ / 32) >= 0);
+}
+
+static bool xmodem_probe(void) {
+	return xmodem_echo(xmodem_probe_data, sizeof(xmodem_probe_data)) == XMODEM_OK;
+}
+
+// Start at 9600 bps, where the host listens, and ask for each faster rate in
+// turn. A rate is accepted once the probe pattern round-trips intact.
+uint8_t xmodem_open_auto(void) {
+	xmodem_open(XMODEM_RATE_9600);
+	cpu_irq_disable();
+
+	xmodem_rate_max = XMODEM_RATE_9600;
+	for (uint8_t rate = XMODEM_RATE_COUNT - 1; rate > XMODEM_RATE_9600; rate--) {
+		if (!xmodem_request_rate(rate)) {
+			// plain XMODEM host; stay at 9600 bps
+			xmodem_set_rate(XMODEM_RATE_9600);
+			goto End;
+		}
+		if (xmodem_probe()) {
+			xmodem_rate_max = rate;
+			break;
+		}
+		// let the host give up on this rate too
+		xmodem_set_rate(XMODEM_RATE_9600);
+		uint32_t start = timer_ticks();
+		while ((timer_ticks() - start) < XMODEM_AUTO_TIMEOUT_TICKS);
+		xmodem_flush();
+	}
+
+	xmodem_auto = true;
+	xmodem_clean_blocks = 0;
+	xmodem_clean_target = XMODEM_AUTO_CLEAN_BLOCKS;
+End:
+	ws_hwint_ack(0xFF);
+	cpu_irq_enable();
+	return xmodem_rate;
+}
+
+static void xmodem_auto_step_down(void) {
+	if (!xmodem_auto || xmodem_rate == XMODEM_RATE_9600) return;
+	xmodem_clean_blocks = 0;
+	if (xmodem_clean_target < 0x4000) xmodem_clean_target <<= 1;
+	xmodem_stats.rate_changes++;
+	// if the echo is lost, the host steps down on its own
+	xmodem_request_rate(xmodem_rate - 1);
+}
+
+static void xmodem_auto_block_done(bool clean) {
+	if (!xmodem_auto) return;
+	if (!clean) {
+		xmodem_clean_blocks = 0;
+	} else if (++xmodem_clean_blocks >= xmodem_clean_target && xmodem_rate < xmodem_rate_max) {
+		xmodem_clean_blocks = 0;
+		xmodem_stats.rate_changes++;
+		xmodem_request_rate(xmodem_rate + 1);
+	}
+}
+
+// call after SOH/STX
+static uint8_t xmodem_read_block(uint8_t __far* block, uint16_t len) {
+	uint8_t idx = ws_serial_getc();
+	uint8_t idx_inv = ws_serial_getc();
+	uint16_t sum = 0;
+	bool valid;
+
+	if (idx == xmodem_idx && block != NULL) {
+		uint16_t received = xmodem_crc
+			? xmodem_io_read_crc(block, len, &sum)
+			: xmodem_io_read_sum(block, len, &sum);
+		if (received != len) {
+			return XMODEM_TIMEOUT;
+		}
+	} else {
+		// a repeated previous block is read in full, then acknowledged
+		for (uint16_t i = 0; i < len; i++) {
+			int16_t v = xmodem_getc_timeout(TIMER_HZ / 4);
+			if (v < 0) {
+				return XMODEM_TIMEOUT;
+			}
+			sum = xmodem_crc ? crc16_update(sum, v) : (uint8_t) (sum + v);
+		}
+	}
+
+	if (xmodem_crc) {
+		int16_t hi = xmodem_getc_timeout(TIMER_HZ / 4);
+		int16_t lo = xmodem_getc_timeout(TIMER_HZ / 4);
+		valid = hi >= 0 && lo >= 0 && sum == ((hi << 8) | lo);
+	} else {
+		valid = sum == xmodem_getc_timeout(TIMER_HZ / 4);
+	}
+	if (!valid || (idx ^ 0xFF) != idx_inv) {
+		return XMODEM_ERROR;
+	}
+	if (idx == xmodem_idx) {
+		return XMODEM_OK;
+	} else if (idx == (uint8_t) (xmodem_idx - 1)) {
+		return XMODEM_DUPLICATE;
+	} else {
+		return XMODEM_CANCEL;
+	}
+}
+
+static void xmodem_write_block(const uint8_t __far* block, uint16_t len) {
+	PROFILE_BEGIN(PROFILE_XMODEM_WRITE_BLOCK);
+	ws_serial_putc(len > XMODEM_BLOCK_SIZE ? STX : SOH);
 	ws_serial_putc(xmodem_idx);
 	ws_serial_putc(xmodem_idx ^ 0xFF);
 
-	uint8_t checksum = 0;
-	for (uint16_t i = 0; i < XMODEM_BLOCK_SIZE; i++) {
-		ws_serial_putc(block[i]);
-		checksum += block[i];
+	if (xmodem_crc) {
+		uint16_t crc = xmodem_io_write_crc(block, len);
+		ws_serial_putc(crc >> 8);
+		ws_serial_putc(crc);
+	} else {
+		ws_serial_putc(xmodem_io_write_sum(block, len));
 	}
-
-	ws_serial_putc(checksum);
+	PROFILE_END(PROFILE_XMODEM_WRITE_BLOCK);
 }
 
 uint8_t xmodem_recv_start(void) {
 	xmodem_idx = 1;
 	xmodem_retry = 1;
+	// ask for CRC mode first, falling back to checksums for older senders
+	xmodem_crc = true;
+	xmodem_start_tries = 0;
 
 	return XMODEM_OK;
 }
 
-uint8_t xmodem_recv_block(uint8_t __far* block) {
+uint8_t xmodem_recv_block(uint8_t __far* block, uint16_t *len) {
+	if (!xmodem_retry) {
+		// the previous block arrived intact
+		xmodem_auto_block_done(true);
+	}
 recv_block_start:
-	ws_serial_putc(xmodem_retry ? NAK : ACK);
+	if (xmodem_retry && !(xmodem_retry % XMODEM_AUTO_RETRIES)) {
+		xmodem_auto_step_down();
+	}
+	if (!xmodem_retry) {
+		ws_serial_putc(ACK);
+	} else {
+		ws_serial_putc((xmodem_idx == 1 && xmodem_crc) ? CRC : NAK);
+	}
 
+	uint32_t start = timer_ticks();
 	while (1) {
 		if (xmodem_poll_exit()) {
 			return XMODEM_SELF_CANCEL;
@@ -114,13 +416,23 @@ recv_block_start:
 			} else if (r == EOT) {
 				ws_serial_putc(ACK);
 				return XMODEM_COMPLETE;
-			} else if (r == SOH) {
-				uint8_t result = xmodem_read_block(block);
+			} else if (r == SOH || r == STX) {
+				*len = (r == STX) ? XMODEM_BLOCK_SIZE_MAX : XMODEM_BLOCK_SIZE;
+				uint32_t io_start = timer_ticks();
+				xmodem_stats.wait_ticks += io_start - start;
+				uint8_t result = xmodem_read_block(block, *len);
+				start = timer_ticks();
+				xmodem_stats.io_ticks += start - io_start;
 				if (result == XMODEM_OK) {
 					xmodem_idx++;
 					xmodem_retry = 0;
+					xmodem_stats.bytes += *len;
+					xmodem_stats.blocks++;
 					return XMODEM_OK;
-				} else if (result == XMODEM_ERROR) {
+				} else if (result == XMODEM_DUPLICATE) {
+					ws_serial_putc(ACK);
+				} else if (result == XMODEM_ERROR || result == XMODEM_TIMEOUT) {
+					if (result == XMODEM_TIMEOUT) xmodem_stats.timeouts++;
 					goto recv_block_error;
 				} else {
 					ws_serial_putc(CAN);
@@ -129,25 +441,48 @@ recv_block_start:
 			} else {
 recv_block_error:
 				xmodem_retry++;
+				xmodem_stats.naks++;
+				xmodem_stats.retries++;
 				if (xmodem_retry > 10) {
 					return XMODEM_ERROR;
 				}
+				xmodem_purge();
 				goto recv_block_start;
 			}
+		} else if (xmodem_idx == 1 && xmodem_retry
+			&& (timer_ticks() - start) >= XMODEM_START_TIMEOUT_TICKS) {
+			// the sender has not started yet; ask again
+			if (++xmodem_start_tries >= XMODEM_START_CRC_TRIES) {
+				xmodem_crc = false;
+			}
+			goto recv_block_start;
+		} else if (xmodem_auto && !(xmodem_idx == 1 && xmodem_retry)
+			&& (timer_ticks() - start) >= XMODEM_AUTO_TIMEOUT_TICKS) {
+			// our ACK or NAK was lost, or the host stepped down without us
+			xmodem_stats.wait_ticks += timer_ticks() - start;
+			xmodem_stats.timeouts++;
+			goto recv_block_error;
 		}
 	}
 }
 
+void xmodem_set_idle_hook(void (*hook)(void)) {
+	xmodem_idle_hook = hook;
+}
+
 uint8_t xmodem_send_start(void) {
 	xmodem_idx = 1;
 	xmodem_retry = 0;
+	xmodem_block_size = XMODEM_BLOCK_SIZE;
+	xmodem_grow_blocks = 0;
 
 	while (!xmodem_poll_exit()) {
 		int16_t r = ws_serial_getc_nonblock();
 		if (r >= 0) {
 			if (r == CAN) {
 				return XMODEM_CANCEL;
-			} else if (r == NAK) {
+			} else if (r == NAK || r == CRC) {
+				xmodem_crc = r == CRC;
 				return XMODEM_OK;
 			}
 		}
@@ -155,11 +490,36 @@ uint8_t xmodem_send_start(void) {
 	return XMODEM_SELF_CANCEL;
 }
 
-uint8_t xmodem_send_block(const uint8_t __far* block) {
-	uint8_t retries = 10;
+uint16_t xmodem_send_block_size(void) {
+	return xmodem_block_size;
+}
+
+static void xmodem_adapt_block_size(bool clean) {
+	if (!clean) {
+		xmodem_block_size = XMODEM_BLOCK_SIZE;
+		xmodem_grow_blocks = 0;
+	} else if (xmodem_crc && xmodem_block_size < XMODEM_BLOCK_SIZE_MAX
+		&& ++xmodem_grow_blocks >= XMODEM_GROW_BLOCKS) {
+		// 1024-byte blocks are only expected by receivers asking for CRC
+		xmodem_block_size = XMODEM_BLOCK_SIZE_MAX;
+	}
+}
+
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t len) {
+	uint8_t retries = 0;
 send_write_again:
-	if ((retries--) == 0) return XMODEM_ERROR;
-	xmodem_write_block(block);
+	if (retries) {
+		if (retries >= 10) return XMODEM_ERROR;
+		if (!(retries % XMODEM_AUTO_RETRIES)) xmodem_auto_step_down();
+	}
+	uint32_t start = timer_ticks();
+	xmodem_write_block(block, len);
+	if (xmodem_idle_hook != NULL) {
+		xmodem_idle_hook();
+	}
+	uint32_t io_end = timer_ticks();
+	xmodem_stats.io_ticks += io_end - start;
+	start = io_end;
 
 	while (!xmodem_poll_exit()) {
 		int16_t r = ws_serial_getc_nonblock();
@@ -167,11 +527,27 @@ send_write_again:
 			if (r == CAN) {
 				return XMODEM_CANCEL;
 			} else if (r == NAK) {
+				xmodem_stats.wait_ticks += timer_ticks() - start;
+				xmodem_stats.naks++;
+				xmodem_stats.retries++;
+				retries++;
 				goto send_write_again;
 			} else if (r == ACK) {
+				xmodem_stats.wait_ticks += timer_ticks() - start;
+				xmodem_stats.bytes += len;
+				xmodem_stats.blocks++;
 				xmodem_idx++;
+				xmodem_adapt_block_size(!retries);
+				xmodem_auto_block_done(!retries);
 				return XMODEM_OK;
 			}
+		} else if (xmodem_auto && (timer_ticks() - start) >= XMODEM_AUTO_TIMEOUT_TICKS) {
+			// the host may have stepped down without us
+			xmodem_stats.wait_ticks += timer_ticks() - start;
+			xmodem_stats.timeouts++;
+			xmodem_stats.retries++;
+			retries++;
+			goto send_write_again;
 		}
 	}
 	return XMODEM_SELF_CANCEL;
@@ -27,21 +27,110 @@
 #include <stdint.h>
 
 #define XMODEM_BLOCK_SIZE 128
+#define XMODEM_BLOCK_SIZE_MAX 1024
 
 #define XMODEM_OK          0 /* OK */
 #define XMODEM_CANCEL      1 /* user cancellation */
 #define XMODEM_SELF_CANCEL 2 /* local cancellation */
 #define XMODEM_ERROR       3 /* transfer error */
 #define XMODEM_COMPLETE    4 /* no more blocks to receive */
+#define XMODEM_TIMEOUT     5 /* no response in time */
+
+#define XMODEM_RATE_9600   0
+#define XMODEM_RATE_38400  1
+#define XMODEM_RATE_192000 2
+#define XMODEM_RATE_COUNT  3
+#define XMODEM_RATE_AUTO   3 /* negotiated, see xmodem_open_auto() */
+
+/*
+ * Host-side contract for rate changes:
+ * - ESC 'B' rate ~rate is echoed at the current rate, then the host
+ *   switches to the new rate. These may appear in place of a block header
+ *   (device sending) or in place of ACK/NAK (device receiving).
+ * - ESC 'P' followed by 16 probe bytes is echoed as-is.
+ * - ESC 'H' followed by the 16-byte cartridge header and its CRC-16 (big
+ *   endian) asks for the cartridge's sizes, before a transfer at 9600 bps.
+ *   The host answers ESC 'H', then ROM banks, SRAM kilobytes and EEPROM
+ *   bytes (16-bit little endian each) and their CRC-16, with all zeroes
+ *   for a cartridge it does not know.
+ * - During a negotiated session, a host which sees no valid traffic for
+ *   one second steps down by one rate (or back to 9600 bps while still
+ *   negotiating).
+ */
+#define XMODEM_ESC 0x1B
+#define XMODEM_ESC_RATE 'B'
+#define XMODEM_ESC_PROBE 'P'
+#define XMODEM_ESC_HEADER 'H'
+
+typedef struct {
+	uint32_t bytes; /* payload bytes acknowledged */
+	uint32_t ticks; /* since xmodem_stats_reset(), updated by xmodem_stats_update() */
+	uint32_t wait_ticks; /* waiting for the other side: link latency, host */
+	uint32_t io_ticks; /* moving block bytes over the wire */
+	uint32_t flash_program_ticks; /* filled in by flash writers */
+	uint32_t flash_erase_ticks;
+	uint16_t blocks;
+	uint16_t naks;
+	uint16_t retries;
+	uint16_t timeouts;
+	uint8_t rate_changes;
+} xmodem_stats_t;
+
+extern xmodem_stats_t xmodem_stats;
+
+typedef struct {
+	uint16_t rom_banks; /* 64 KB each */
+	uint16_t sram_kbytes;
+	uint16_t eeprom_bytes;
+} xmodem_cart_sizes_t;
+
+void xmodem_stats_reset(void);
+void xmodem_stats_update(void);
+uint32_t xmodem_stats_bytes_per_second(void);
+/**
+ * Send a one-line summary record to the host, after the transfer proper:
+ * "\r\nWSBT-STATS key=value ...\r\n".
+ */
+void xmodem_stats_send(void);
 
 bool xmodem_poll_exit(void);
 
-void xmodem_open(uint8_t baudrate);
+void xmodem_open(uint8_t rate);
+uint8_t xmodem_open_auto(void);
+void xmodem_set_rate(uint8_t rate);
+bool xmodem_request_rate(uint8_t rate);
 void xmodem_close(void);
 
+/**
+ * Ask the host for the sizes of the cartridge with this header. Opens and
+ * closes the port itself. Returns false if no host answered in time or
+ * the host does not know the cartridge.
+ */
+bool xmodem_query_sizes(const uint8_t __far* header, xmodem_cart_sizes_t *sizes);
+
+int16_t xmodem_getc_timeout(uint16_t ticks);
+void xmodem_flush(void);
+uint8_t xmodem_echo(const uint8_t __far* data, uint16_t len);
+
+/**
+ * Called once per sent block while waiting for the receiver's response, so
+ * the caller can prepare the next block during the round trip.
+ */
+void xmodem_set_idle_hook(void (*hook)(void));
+
 uint8_t xmodem_send_start(void);
-uint8_t xmodem_send_block(const uint8_t __far* block);
+/**
+ * Preferred size of the next block: grows to XMODEM_BLOCK_SIZE_MAX while
+ * blocks are acknowledged cleanly (CRC mode only), and drops back to
+ * XMODEM_BLOCK_SIZE after a NAK.
+ */
+uint16_t xmodem_send_block_size(void);
+uint8_t xmodem_send_block(const uint8_t __far* block, uint16_t len);
 uint8_t xmodem_send_finish(void);
 
 uint8_t xmodem_recv_start(void);
-uint8_t xmodem_recv_block(uint8_t __far* block);
+/**
+ * Receive one block into a buffer of at least XMODEM_BLOCK_SIZE_MAX bytes
+ * (or NULL to discard it); the block's length is stored in len.
+ */
+uint8_t xmodem_recv_block(uint8_t __far* block, uint16_t *len);
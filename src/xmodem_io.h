@@ -0,0 +1,34 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <wonderful.h>
+
+// Send len bytes, polling the serial port directly; returns the checksum.
+uint8_t xmodem_io_write_sum(const uint8_t __far* data, uint16_t len);
+// Send len bytes, polling the serial port directly; returns the CRC-16.
+uint16_t xmodem_io_write_crc(const uint8_t __far* data, uint16_t len);
+
+/**
+ * Receive up to len bytes, polling the serial port directly. Returns the
+ * number of bytes received before a byte timed out; the checksum or CRC-16
+ * of the received bytes is stored to result.
+ */
+uint16_t xmodem_io_read_sum(uint8_t __far* data, uint16_t len, uint16_t *result);
+uint16_t xmodem_io_read_crc(uint8_t __far* data, uint16_t len, uint16_t *result);
@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2022, 2023 Adrian Siekierka
+ *
+ * WS Backup Tool is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * WS Backup Tool is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with WS Backup Tool. If not, see <https://www.gnu.org/licenses/>. 
+ */
+
+#include <wonderful.h>
+
+	.arch	i186
+	.code16
+	.intel_syntax noprefix
+	.global xmodem_io_write_sum
+	.global xmodem_io_write_crc
+	.global xmodem_io_read_sum
+	.global xmodem_io_read_crc
+
+	// Serial ports: 0xB1 data, 0xB3 status.
+	// Status bits: 0 = receive buffer full, 2 = transmit buffer empty.
+	//
+	// Each byte is written to the port before its checksum/CRC is updated,
+	// so the update runs while the byte is being shifted out.
+
+	.align 2
+xmodem_io_write_sum:
+	push	si
+	push	ds
+
+	mov si, ax
+	mov ds, dx
+	xor bx, bx
+	cld
+	jcxz xmodem_io_write_sum_end
+
+	.balign 2, 0x90
+xmodem_io_write_sum_loop:
+	in al, 0xB3
+	test al, 0x04
+	jz xmodem_io_write_sum_loop
+	lodsb
+	out 0xB1, al
+	add bl, al
+	loop xmodem_io_write_sum_loop
+
+xmodem_io_write_sum_end:
+	mov ax, bx
+	pop	ds
+	pop	si
+
+	IA16_RET
+
+	.align 2
+xmodem_io_write_crc:
+	push	si
+	push	di
+	push	ds
+
+	mov si, ax
+	mov ds, dx
+	xor bx, bx
+	cld
+	jcxz xmodem_io_write_crc_end
+
+	.balign 2, 0x90
+xmodem_io_write_crc_loop:
+	in al, 0xB3
+	test al, 0x04
+	jz xmodem_io_write_crc_loop
+	lodsb
+	out 0xB1, al
+	// crc = (crc << 8) ^ table[(crc >> 8) ^ byte]
+	xor al, bh
+	mov bh, bl
+	mov bl, 0
+	xor ah, ah
+	shl ax, 1
+	mov di, ax
+	xor bx, ss:[xmodem_io_crc_table + di]
+	loop xmodem_io_write_crc_loop
+
+xmodem_io_write_crc_end:
+	mov ax, bx
+	pop	ds
+	pop	di
+	pop	si
+
+	IA16_RET
+
+	// Each byte is waited for up to 65536 status polls (~0.2 seconds).
+	// Returns the number of bytes received; the checksum/CRC is stored
+	// to the pointer passed on the stack.
+
+	.align 2
+xmodem_io_read_sum:
+	push	si
+	push	di
+	push	es
+	push	bp
+	mov	bp, sp
+	push	cx
+
+	mov di, ax
+	mov es, dx
+	xor bx, bx
+	cld
+	jcxz xmodem_io_read_sum_end
+
+	.balign 2, 0x90
+xmodem_io_read_sum_loop:
+	xor dx, dx
+xmodem_io_read_sum_poll:
+	in al, 0xB3
+	test al, 0x01
+	jnz xmodem_io_read_sum_byte
+	dec dx
+	jnz xmodem_io_read_sum_poll
+	jmp xmodem_io_read_sum_end
+xmodem_io_read_sum_byte:
+	in al, 0xB1
+	stosb
+	add bl, al
+	loop xmodem_io_read_sum_loop
+
+xmodem_io_read_sum_end:
+	mov ax, [bp - 2]
+	sub ax, cx
+	mov si, [bp + IA16_CALL_STACK_OFFSET(8)]
+	mov [si], bx
+
+	mov	sp, bp
+	pop	bp
+	pop	es
+	pop	di
+	pop	si
+
+	IA16_RET 0x2
+
+	.align 2
+xmodem_io_read_crc:
+	push	si
+	push	di
+	push	es
+	push	bp
+	mov	bp, sp
+	push	cx
+
+	mov di, ax
+	mov es, dx
+	xor bx, bx
+	cld
+	jcxz xmodem_io_read_crc_end
+
+	.balign 2, 0x90
+xmodem_io_read_crc_loop:
+	xor dx, dx
+xmodem_io_read_crc_poll:
+	in al, 0xB3
+	test al, 0x01
+	jnz xmodem_io_read_crc_byte
+	dec dx
+	jnz xmodem_io_read_crc_poll
+	jmp xmodem_io_read_crc_end
+xmodem_io_read_crc_byte:
+	in al, 0xB1
+	stosb
+	xor al, bh
+	mov bh, bl
+	mov bl, 0
+	xor ah, ah
+	shl ax, 1
+	mov si, ax
+	xor bx, ss:[xmodem_io_crc_table + si]
+	loop xmodem_io_read_crc_loop
+
+xmodem_io_read_crc_end:
+	mov ax, [bp - 2]
+	sub ax, cx
+	mov si, [bp + IA16_CALL_STACK_OFFSET(8)]
+	mov [si], bx
+
+	mov	sp, bp
+	pop	bp
+	pop	es
+	pop	di
+	pop	si
+
+	IA16_RET 0x2
+
+	.section .rodata
+	.align 2
+	// CRC-16/XMODEM, polynomial 0x1021
+xmodem_io_crc_table:
+	.word 0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7
+	.word 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+	.word 0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6
+	.word 0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE
+	.word 0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485
+	.word 0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D
+	.word 0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4
+	.word 0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC
+	.word 0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823
+	.word 0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B
+	.word 0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12
+	.word 0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A
+	.word 0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41
+	.word 0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49
+	.word 0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70
+	.word 0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78
+	.word 0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F
+	.word 0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067
+	.word 0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E
+	.word 0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256
+	.word 0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D
+	.word 0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405
+	.word 0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C
+	.word 0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634
+	.word 0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB
+	.word 0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3
+	.word 0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A
+	.word 0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92
+	.word 0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9
+	.word 0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1
+	.word 0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8
+	.word 0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0